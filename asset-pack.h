@@ -0,0 +1,34 @@
+#pragma once
+
+#include <stdint.h>
+
+// Layout of the asset pack written by pack-assets.cpp. The file is a header,
+// then entry_count entries, then the sprite atlas as width * height RGBA8
+// texels at atlas_offset, aligned so it can be uploaded straight from a
+// mapping of the file. Each entry names a source image and the rect it
+// occupies in the atlas. The rects include no padding, but each is
+// surrounded by padding texels (atlas_padding in atlas.h) that must also lie
+// inside the atlas, since reloading a sprite rewrites them.
+
+const uint32_t asset_pack_magic = 0x4b505649; // "IVPK"
+const uint32_t asset_pack_version = 2;
+const uint32_t asset_pack_alignment = 64;
+const int asset_pack_name_max = 32;
+
+struct Asset_Pack_Header
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t entry_count;
+    uint32_t atlas_width;
+    uint32_t atlas_height;
+    uint32_t atlas_offset;
+    uint32_t padding; // texels around each rect
+};
+
+struct Asset_Pack_Entry
+{
+    char name[asset_pack_name_max]; // zero terminated
+    int32_t x, y;
+    int32_t width, height;
+};
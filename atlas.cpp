@@ -0,0 +1,128 @@
+#include <stdlib.h>
+#include <string.h>
+#include "atlas.h"
+
+static int compare_by_height(const void *a, const void *b, const Atlas_Image *images)
+{
+    const Atlas_Image *ia = &images[*(const int *)a];
+    const Atlas_Image *ib = &images[*(const int *)b];
+    if (ia->height != ib->height)
+        return ib->height - ia->height;
+    return *(const int *)a - *(const int *)b;
+}
+
+// Lays the images out in rows of decreasing height across a strip of the
+// given width. Returns the height used.
+static int pack_shelves(const Atlas_Image *images, const int *order, int count, int padding, int width, Atlas_Rect *rects)
+{
+    int x = 0;
+    int y = 0;
+    int shelf_height = 0;
+
+    for (int k = 0; k < count; k++)
+    {
+        int i = order[k];
+        const Atlas_Image *image = &images[i];
+        if (image->width <= 0 || image->height <= 0 || !image->data)
+        {
+            rects[i].x = rects[i].y = 0;
+            rects[i].width = rects[i].height = 0;
+            continue;
+        }
+
+        int w = image->width + 2 * padding;
+        int h = image->height + 2 * padding;
+        if (w > width)
+            return -1;
+
+        if (x + w > width)
+        {
+            x = 0;
+            y += shelf_height;
+            shelf_height = 0;
+        }
+
+        rects[i].x = x + padding;
+        rects[i].y = y + padding;
+        rects[i].width = image->width;
+        rects[i].height = image->height;
+
+        x += w;
+        if (h > shelf_height)
+            shelf_height = h;
+    }
+
+    return y + shelf_height;
+}
+
+void blit_atlas_image(Atlas *atlas, Atlas_Rect rect, int padding, const uint8_t *data)
+{
+    int stride = atlas->width * 4;
+
+    for (int row = -padding; row < rect.height + padding; row++)
+    {
+        int src_row = row < 0 ? 0 : (row >= rect.height ? rect.height - 1 : row);
+        const uint8_t *src = data + (size_t)src_row * rect.width * 4;
+        uint8_t *dest = atlas->data + (size_t)(rect.y + row) * stride + (size_t)rect.x * 4;
+
+        memcpy(dest, src, (size_t)rect.width * 4);
+        for (int p = 1; p <= padding; p++)
+        {
+            memcpy(dest - 4 * p, src, 4);
+            memcpy(dest + 4 * (rect.width - 1 + p), src + 4 * (rect.width - 1), 4);
+        }
+    }
+}
+
+bool build_atlas(const Atlas_Image *images, int count, int padding, int max_size, Atlas *atlas, Atlas_Rect *rects)
+{
+    // Insertion sort by height; image counts are small.
+    int *order = (int *)malloc((count > 0 ? count : 1) * sizeof(int));
+    for (int i = 0; i < count; i++)
+    {
+        int at = i;
+        order[at] = i;
+        while (at > 0 && compare_by_height(&order[at - 1], &order[at], images) > 0)
+        {
+            int t = order[at - 1];
+            order[at - 1] = order[at];
+            order[at] = t;
+            at--;
+        }
+    }
+
+    int size = 64;
+    while (size <= max_size)
+    {
+        int height = pack_shelves(images, order, count, padding, size, rects);
+        if (height >= 0 && height <= size)
+            break;
+        size *= 2;
+    }
+    free(order);
+
+    if (size > max_size)
+        return false;
+
+    atlas->width = size;
+    atlas->height = size;
+    atlas->data = (uint8_t *)calloc((size_t)size * size, 4);
+
+    for (int i = 0; i < count; i++)
+    {
+        if (rects[i].width > 0)
+        {
+            blit_atlas_image(atlas, rects[i], padding, images[i].data);
+        }
+    }
+
+    return true;
+}
+
+void free_atlas(Atlas *atlas)
+{
+    free(atlas->data);
+    atlas->data = NULL;
+    atlas->width = 0;
+    atlas->height = 0;
+}
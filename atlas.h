@@ -0,0 +1,43 @@
+#pragma once
+
+#include <stdint.h>
+
+// Packs RGBA8 images into a single RGBA8 texel block. Used by the game at
+// startup and by the offline asset packer.
+
+// The game and pack-assets.cpp must pack with the same values: the game
+// refreshes the padding around a rect when it hot-reloads a sprite.
+const int atlas_padding = 1;
+const int atlas_max_size = 4096;
+
+struct Atlas_Image
+{
+    int width;
+    int height;
+    const uint8_t *data; // width * height RGBA8 texels, top row first
+};
+
+struct Atlas_Rect
+{
+    int x, y;
+    int width, height;
+};
+
+struct Atlas
+{
+    int width;
+    int height;
+    uint8_t *data;
+};
+
+// Shelf-packs the images into the smallest power-of-two square atlas up to
+// max_size that fits them. Each image is surrounded by padding texels that
+// repeat its edges, so bilinear filtering at the edge of a rect never reads
+// a neighbouring image. Images with no size get an empty rect. Returns false
+// if the images do not fit.
+bool build_atlas(const Atlas_Image *images, int count, int padding, int max_size, Atlas *atlas, Atlas_Rect *rects);
+
+// Copies an image into its rect and refreshes the padding around it.
+void blit_atlas_image(Atlas *atlas, Atlas_Rect rect, int padding, const uint8_t *data);
+
+void free_atlas(Atlas *atlas);
@@ -0,0 +1,560 @@
+// Benchmarks for the simulation code. This is a unity build so the
+// benchmarks can reach the game's internal structures directly; link it with
+// the headless platform layer built without its main():
+//
+//     g++ -O2 -pthread -DINVADERS_NO_MAIN -o bench-invaders bench-invaders.cpp atlas.cpp profiler.cpp jobs.cpp rng.cpp linux-invaders.cpp headless-gl.cpp
+//
+// Every benchmark runs at several entity counts. Each run is preceded by
+// untimed warmup passes and repeated for a number of timed trials, with the
+// state rebuilt before every pass, and prints one CSV row:
+//
+//     benchmark,count,items,trials,min_ns_per_item,median_ns_per_item,max_ns_per_item
+//
+// count is the number of entities set up, items the number of calls timed
+// in one trial. Usage: bench-invaders [--trials N] [name-prefix...]
+
+#include <stdio.h>
+#include "invaders.cpp"
+
+int bench_trials = 15;
+const int bench_warmup = 2;
+
+// Results are folded into this so the timed work cannot be optimized out.
+volatile uint32_t bench_sink;
+
+struct Bench_Case
+{
+    const char *name;
+    // Builds the state for one pass; not timed.
+    void (*setup)(int count);
+    // The timed work; returns the number of items processed.
+    int64_t (*run)(int count);
+};
+
+int compare_doubles(const void *a, const void *b)
+{
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+void run_bench_case(const Bench_Case *bench, int count)
+{
+    for (int i = 0; i < bench_warmup; i++)
+    {
+        bench->setup(count);
+        bench->run(count);
+    }
+
+    double *ns_per_item = (double *)malloc(bench_trials * sizeof(double));
+    int64_t items = 0;
+    for (int i = 0; i < bench_trials; i++)
+    {
+        bench->setup(count);
+        double start = get_time();
+        items = bench->run(count);
+        double seconds = get_time() - start;
+        ns_per_item[i] = seconds * 1e9 / (double)(items > 0 ? items : 1);
+    }
+
+    qsort(ns_per_item, bench_trials, sizeof(double), compare_doubles);
+    printf("%s,%d,%lld,%d,%.3f,%.3f,%.3f\n", bench->name, count, (long long)items, bench_trials,
+           ns_per_item[0], ns_per_item[bench_trials / 2], ns_per_item[bench_trials - 1]);
+    fflush(stdout);
+    free(ns_per_item);
+}
+
+// Shared fixtures. The particle and projectile pools are allocated once, big
+// enough for the largest count; invaders and bullets for the kernels that
+// take pointers live in their own arrays so counts are not limited by the
+// game's fixed arrays.
+
+const int bench_pool_capacity = 1 << 18;
+const int bench_steps = 100;
+const float bench_dt = 1.0f / 120.0f;
+
+Invader *bench_invaders = NULL;
+int bench_invader_capacity = 0;
+
+Vector2 *bench_positions = NULL;
+int bench_position_capacity = 0;
+
+float *bench_floats = NULL;
+int bench_float_capacity = 0;
+
+// Fixture data comes from its own stream, apart from the game's entity streams.
+Rng_Stream bench_rng;
+
+void bench_seed(uint32_t seed)
+{
+    bench_rng = rng_stream(rng_key(seed), 0, 0, 0);
+}
+
+void clear_world(uint32_t seed)
+{
+    bench_seed(seed);
+    world->rng_key = rng_key(seed);
+    world->tick = 0;
+    world->next_entity_id = 1;
+    world->current_dt = bench_dt;
+    world->particle_pool.count = 0;
+    world->projectiles.count = 0;
+    init_emitters();
+    world->live_invader_count = 0;
+    world->bullet_count = 0;
+}
+
+Particle_Emitter *spawn_bench_emitter()
+{
+    Particle_Emitter *emitter = spawn_emitter();
+    emitter->position = make_vector2(rng_float(&bench_rng, 0, 1), rng_float(&bench_rng, 0, 1));
+    emitter->velocity = make_vector2(0, 0.5f);
+    return emitter;
+}
+
+void fill_particles(int count)
+{
+    clear_world(0x1234567);
+    Particle_Emitter *emitter = spawn_bench_emitter();
+    spawn_particles(emitter, count, &bench_rng, NULL);
+}
+
+void fill_invaders(int count)
+{
+    if (count > bench_invader_capacity)
+    {
+        bench_invaders = (Invader *)realloc(bench_invaders, count * sizeof(Invader));
+        bench_invader_capacity = count;
+    }
+
+    bench_seed(0x2345678);
+    for (int i = 0; i < count; i++)
+    {
+        Invader *invader = &bench_invaders[i];
+        memset(invader, 0, sizeof(*invader));
+        invader->bitmap = &invader_bitmaps[i % invader_bitmap_count];
+        invader->sleep_countdown = -1.0f;
+        invader->id = i + 1;
+        init_invader(invader, &bench_rng);
+        invader->position.y = rng_float(&bench_rng, 0.2f, 0.7f);
+    }
+}
+
+void fill_positions(int count)
+{
+    if (count > bench_position_capacity)
+    {
+        bench_positions = (Vector2 *)realloc(bench_positions, count * sizeof(Vector2));
+        bench_position_capacity = count;
+    }
+
+    for (int i = 0; i < count; i++)
+    {
+        bench_positions[i].x = rng_float(&bench_rng, 0.0f, 1.0f);
+        bench_positions[i].y = rng_float(&bench_rng, live_y_min, live_y_max);
+    }
+}
+
+// rng_next and rng_fill_floats: count draws from one stream.
+
+void setup_random(int count)
+{
+    bench_seed(0x3456789);
+    if (count > bench_float_capacity)
+    {
+        bench_floats = (float *)realloc(bench_floats, count * sizeof(float));
+        bench_float_capacity = count;
+    }
+}
+
+int64_t run_rng_next(int count)
+{
+    uint32_t sum = 0;
+    for (int i = 0; i < count; i++)
+    {
+        sum += rng_next(&bench_rng);
+    }
+    bench_sink = sum;
+    return count;
+}
+
+int64_t run_rng_fill_floats(int count)
+{
+    rng_fill_floats(&bench_rng, bench_floats, count, 0, 1);
+    bench_sink = (uint32_t)(bench_floats[count / 2] * 1000.0f);
+    return count;
+}
+
+// sim_particle and sim_particles: one step over count live particles.
+
+int64_t run_sim_particle(int count)
+{
+    for (int i = 0; i < count; i++)
+    {
+        sim_particle(&world->particle_pool, i, bench_dt);
+    }
+    bench_sink = (uint32_t)world->particle_pool.position_x[count / 2];
+    return count;
+}
+
+int64_t run_sim_particles(int count)
+{
+    sim_particles(&world->particle_pool, 0, count, bench_dt);
+    bench_sink = (uint32_t)world->particle_pool.position_x[count / 2];
+    return count;
+}
+
+// sim_projectiles: one step over count projectiles, without contrails,
+// aimed at a ship at the bottom of the playfield. simulate_projectiles adds
+// settling the fates in the serial pass.
+
+void fill_projectiles(int count)
+{
+    clear_world(0x9012345);
+    world->ship_position = make_vector2(0.5f, 0.1f);
+    for (int i = 0; i < count; i++)
+    {
+        Vector2 position = make_vector2(rng_float(&bench_rng, 0, 1), rng_float(&bench_rng, 0, live_y_max));
+        Vector2 velocity = make_vector2(rng_float(&bench_rng, -0.1f, 0.1f), rng_float(&bench_rng, -0.3f, -0.1f));
+        fire_projectile(position, velocity, false);
+    }
+}
+
+int64_t run_sim_projectiles(int count)
+{
+    sim_projectiles(&world->projectiles, 0, count, bench_dt, world->ship_position);
+    bench_sink = world->projectiles.fate[count / 2];
+    return count;
+}
+
+int64_t run_simulate_projectiles(int count)
+{
+    simulate_projectiles();
+    bench_sink = world->projectiles.count;
+    return count;
+}
+
+// spawn_particles and spawn_particles_one: fill an empty pool with count
+// particles in one batch, or with a batch of one per call, which is what an
+// emitter due a single particle in a tick pays.
+
+void setup_spawn_particles(int count)
+{
+    clear_world(0x4567890);
+    spawn_bench_emitter();
+}
+
+int64_t run_spawn_particles_one(int count)
+{
+    Particle_Emitter *emitter = &world->emitters[world->live_emitters[0]];
+    for (int i = 0; i < count; i++)
+    {
+        spawn_particles(emitter, 1, &bench_rng, NULL);
+    }
+    bench_sink = world->particle_pool.count;
+    return count;
+}
+
+int64_t run_spawn_particles(int count)
+{
+    Particle_Emitter *emitter = &world->emitters[world->live_emitters[0]];
+    spawn_particles(emitter, count, &bench_rng, NULL);
+    bench_sink = world->particle_pool.count;
+    return count;
+}
+
+// sincos: cosf/sinf against fast_sincos, four lanes at a time where the
+// target has SIMD, over count angles.
+
+void setup_sincos(int count)
+{
+    setup_random(count);
+    rng_fill_floats(&bench_rng, bench_floats, count, 0, TAU);
+}
+
+int64_t run_libm_sincos(int count)
+{
+    float sum = 0;
+    for (int i = 0; i < count; i++)
+    {
+        sum += cosf(bench_floats[i]) + sinf(bench_floats[i]);
+    }
+    bench_sink = (uint32_t)(sum * 1000.0f);
+    return count;
+}
+
+int64_t run_fast_sincos(int count)
+{
+    float sum = 0;
+    int i = 0;
+#if INVADERS_AVX || INVADERS_SSE2
+    __m128 vsum = _mm_setzero_ps();
+    for (; i + 4 <= count; i += 4)
+    {
+        __m128 s, c;
+        fast_sincos_4(_mm_loadu_ps(bench_floats + i), &s, &c);
+        vsum = _mm_add_ps(vsum, _mm_add_ps(c, s));
+    }
+    float lanes[4];
+    _mm_storeu_ps(lanes, vsum);
+    sum = lanes[0] + lanes[1] + lanes[2] + lanes[3];
+#endif
+    for (; i < count; i++)
+    {
+        float s, c;
+        fast_sincos(bench_floats[i], &s, &c);
+        sum += c + s;
+    }
+    bench_sink = (uint32_t)(sum * 1000.0f);
+    return count;
+}
+
+// update_emitter: count producing emitters advanced bench_steps ticks,
+// spawning into the pool as they go.
+
+void setup_update_emitter(int count)
+{
+    clear_world(0x5678901);
+    for (int i = 0; i < count; i++)
+    {
+        spawn_bench_emitter();
+    }
+}
+
+int64_t run_update_emitter(int count)
+{
+    for (int step = 0; step < bench_steps; step++)
+    {
+        for (int i = 0; i < world->live_emitter_count; i++)
+        {
+            update_emitter(&world->emitters[world->live_emitters[i]]);
+        }
+    }
+    bench_sink = world->particle_pool.count;
+    return (int64_t)count * bench_steps;
+}
+
+// spawn_emitter: take count slots from the free list.
+
+void setup_spawn_emitter(int count)
+{
+    clear_world(0x6789012);
+}
+
+int64_t run_spawn_emitter(int count)
+{
+    uint32_t sum = 0;
+    for (int i = 0; i < count; i++)
+    {
+        sum += (uint32_t)(spawn_emitter() - world->emitters);
+    }
+    bench_sink = sum;
+    return count;
+}
+
+// simulate_invader: count invaders advanced bench_steps ticks.
+
+void setup_simulate_invader(int count)
+{
+    world->current_dt = bench_dt;
+    fill_invaders(count);
+}
+
+int64_t run_simulate_invader(int count)
+{
+    for (int step = 0; step < bench_steps; step++)
+    {
+        for (int i = 0; i < count; i++)
+        {
+            simulate_invader(&bench_invaders[i]);
+        }
+    }
+    bench_sink = (uint32_t)(bench_invaders[count / 2].position.x * 1000.0f);
+    return (int64_t)count * bench_steps;
+}
+
+// test_against_invaders: a full bullet array against count live invaders,
+// as simulate_bullets does it, including destroying whatever is hit.
+
+void setup_test_against_invaders(int count)
+{
+    clear_world(0x7890123);
+    fill_invaders(count);
+    memcpy(world->live_invaders, bench_invaders, count * sizeof(Invader));
+    world->live_invader_count = count;
+
+    // Half the bullets start on an invader, half anywhere.
+    fill_positions(bullet_max);
+    for (int i = 0; i < bullet_max; i += 2)
+    {
+        bench_positions[i] = world->live_invaders[i % count].position;
+    }
+    world->bullet_count = bullet_max;
+    for (int i = 0; i < world->bullet_count; i++)
+    {
+        world->bullets[i].position = bench_positions[i];
+    }
+}
+
+int64_t run_test_against_invaders(int count)
+{
+    int hits = 0;
+    build_invader_grid(&world->invader_grid, world->live_invaders, world->live_invader_count);
+    for (int i = 0; i < world->bullet_count; i++)
+    {
+        hits += test_against_invaders(&world->bullets[i]);
+    }
+    remove_destroyed_invaders();
+    bench_sink = hits;
+    return world->bullet_count;
+}
+
+// The broad-phase on its own, grid against brute force, at invader counts
+// well past what the game spawns.
+
+int64_t run_find_invader_brute_force(int count)
+{
+    uint32_t sum = 0;
+    for (int i = 0; i < bullet_max; i++)
+    {
+        sum += find_invader_brute_force(bench_invaders, count, bench_positions[i], INVADER_RADIUS);
+    }
+    bench_sink = sum;
+    return bullet_max;
+}
+
+int64_t run_find_invader_in_grid(int count)
+{
+    uint32_t sum = 0;
+    build_invader_grid(&world->invader_grid, bench_invaders, count);
+    for (int i = 0; i < bullet_max; i++)
+    {
+        sum += find_invader_in_grid(&world->invader_grid, bench_invaders, bench_positions[i], INVADER_RADIUS);
+    }
+    bench_sink = sum;
+    return bullet_max;
+}
+
+void setup_find_invader(int count)
+{
+    fill_invaders(count);
+    bench_seed(0x8901234);
+    fill_positions(bullet_max);
+}
+
+// The grid must agree with brute force, or its timings mean nothing.
+bool check_find_invader(int count)
+{
+    setup_find_invader(count);
+    build_invader_grid(&world->invader_grid, bench_invaders, count);
+    for (int i = 0; i < bullet_max; i++)
+    {
+        int expected = find_invader_brute_force(bench_invaders, count, bench_positions[i], INVADER_RADIUS);
+        int found = find_invader_in_grid(&world->invader_grid, bench_invaders, bench_positions[i], INVADER_RADIUS);
+        if (found != expected)
+        {
+            fprintf(stderr, "find_invader_in_grid: bullet %d found %d, brute force %d, with %d invaders\n",
+                    i, found, expected, count);
+            return false;
+        }
+    }
+    return true;
+}
+
+// fast_sincos only has to be good to sprite precision.
+bool check_sincos()
+{
+    for (int i = -4000; i <= 4000; i++)
+    {
+        float theta = i * (TAU / 1000.0f);
+        float s, c;
+        fast_sincos(theta, &s, &c);
+        if (fabsf(s - sinf(theta)) > 1e-5f || fabsf(c - cosf(theta)) > 1e-5f)
+        {
+            fprintf(stderr, "fast_sincos(%g) = %g, %g; libm %g, %g\n", theta, s, c, sinf(theta), cosf(theta));
+            return false;
+        }
+    }
+    return true;
+}
+
+struct Bench_Entry
+{
+    Bench_Case bench;
+    int counts[4]; // zero terminated
+};
+
+const Bench_Entry bench_entries[] = {
+    {{"rng_next", setup_random, run_rng_next}, {1000, 100000}},
+    {{"rng_fill_floats", setup_random, run_rng_fill_floats}, {1000, 100000}},
+    {{"sim_particle", fill_particles, run_sim_particle}, {1000, 8192, 100000}},
+    {{"sim_particles", fill_particles, run_sim_particles}, {1000, 8192, 100000}},
+    {{"sim_projectiles", fill_projectiles, run_sim_projectiles}, {1000, 8192, 100000}},
+    {{"simulate_projectiles", fill_projectiles, run_simulate_projectiles}, {1000, 8192, 100000}},
+    {{"spawn_particles", setup_spawn_particles, run_spawn_particles}, {1000, 8192, 100000}},
+    {{"spawn_particles_one", setup_spawn_particles, run_spawn_particles_one}, {1000, 8192, 100000}},
+    {{"libm_sincos", setup_sincos, run_libm_sincos}, {1000, 100000}},
+    {{"fast_sincos", setup_sincos, run_fast_sincos}, {1000, 100000}},
+    {{"update_emitter", setup_update_emitter, run_update_emitter}, {10, 50, emitter_max}},
+    {{"spawn_emitter", setup_spawn_emitter, run_spawn_emitter}, {10, 50, emitter_max}},
+    {{"simulate_invader", setup_simulate_invader, run_simulate_invader}, {15, live_invader_max, 10000}},
+    {{"test_against_invaders", setup_test_against_invaders, run_test_against_invaders}, {num_desired_invaders, live_invader_max}},
+    {{"find_invader_brute_force", setup_find_invader, run_find_invader_brute_force}, {100, 10000, 100000}},
+    {{"find_invader_in_grid", setup_find_invader, run_find_invader_in_grid}, {100, 10000, 100000}},
+};
+
+bool matches_filter(const char *name, char **filters, int filter_count)
+{
+    if (filter_count == 0)
+        return true;
+
+    for (int i = 0; i < filter_count; i++)
+    {
+        if (strncmp(name, filters[i], strlen(filters[i])) == 0)
+            return true;
+    }
+    return false;
+}
+
+int main(int argc, char **argv)
+{
+    char **filters = (char **)malloc(argc * sizeof(char *));
+    int filter_count = 0;
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--trials") == 0 && i + 1 < argc)
+        {
+            bench_trials = atoi(argv[++i]);
+            if (bench_trials < 1)
+                bench_trials = 1;
+        }
+        else
+        {
+            filters[filter_count++] = argv[i];
+        }
+    }
+
+    alloc_world(world, bench_pool_capacity, bench_pool_capacity);
+    init_emitters();
+
+    if (!check_find_invader(100) || !check_find_invader(10000) || !check_sincos())
+    {
+        return 1;
+    }
+
+    printf("benchmark,count,items,trials,min_ns_per_item,median_ns_per_item,max_ns_per_item\n");
+    for (int i = 0; i < (int)(sizeof(bench_entries) / sizeof(bench_entries[0])); i++)
+    {
+        const Bench_Entry *entry = &bench_entries[i];
+        if (!matches_filter(entry->bench.name, filters, filter_count))
+            continue;
+
+        for (int c = 0; c < 4 && entry->counts[c] > 0; c++)
+        {
+            run_bench_case(&entry->bench, entry->counts[c]);
+        }
+    }
+
+    free(filters);
+    return 0;
+}
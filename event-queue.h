@@ -0,0 +1,45 @@
+#pragma once
+
+#include <atomic>
+#include "invaders.h"
+
+// Lock-free ring of Events with one producer thread and one consumer thread.
+// Each side advances only its own index and reads the other's, with release
+// stores and acquire loads ordering the slot contents against the indices.
+// The indices run freely and wrap through the power-of-two slot count.
+
+const uint32_t event_queue_max = 1024;
+
+struct Event_Queue
+{
+    alignas(64) std::atomic<uint32_t> head; // next slot to pop, written by the consumer
+    alignas(64) std::atomic<uint32_t> tail; // next slot to push, written by the producer
+    alignas(64) Event events[event_queue_max];
+    std::atomic<uint32_t> dropped;
+};
+
+// Returns false, and counts the event as dropped, when the queue is full.
+inline bool event_queue_push(Event_Queue *queue, const Event &event)
+{
+    uint32_t tail = queue->tail.load(std::memory_order_relaxed);
+    if (tail - queue->head.load(std::memory_order_acquire) == event_queue_max)
+    {
+        queue->dropped.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+
+    queue->events[tail % event_queue_max] = event;
+    queue->tail.store(tail + 1, std::memory_order_release);
+    return true;
+}
+
+inline bool event_queue_pop(Event_Queue *queue, Event *event)
+{
+    uint32_t head = queue->head.load(std::memory_order_relaxed);
+    if (head == queue->tail.load(std::memory_order_acquire))
+        return false;
+
+    *event = queue->events[head % event_queue_max];
+    queue->head.store(head + 1, std::memory_order_release);
+    return true;
+}
@@ -0,0 +1,913 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <GL/gl.h>
+#include "invaders.h"
+#include "headless-gl.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define HEADLESS_GL_SSE2 1
+#endif
+
+// Software implementation of the fixed-function GL subset used by the game:
+// GL_TRIANGLES from glBegin/glEnd or client-side vertex arrays, with
+// per-vertex color and texture coordinates, an orthographic
+// projection, bilinear GL_LINEAR/GL_REPEAT RGBA8 textures modulated by the
+// vertex color, and SRC_ALPHA/ONE_MINUS_SRC_ALPHA blending. Triangles are
+// buffered until glEnd or glDrawArrays and rasterized as horizontal spans. With
+// SSE2 a span is shaded, sampled and blended four adjacent pixels at a time,
+// one color channel per register, and its last few pixels one at a time.
+
+// Colors are kept in the 0..255 range while shading.
+#if HEADLESS_GL_SSE2
+
+typedef __m128 Color4;
+
+static inline Color4 color4(float r, float g, float b, float a) { return _mm_setr_ps(r, g, b, a); }
+static inline Color4 color4_add(Color4 a, Color4 b) { return _mm_add_ps(a, b); }
+static inline Color4 color4_mul(Color4 a, Color4 b) { return _mm_mul_ps(a, b); }
+static inline Color4 color4_scale(Color4 a, float s) { return _mm_mul_ps(a, _mm_set1_ps(s)); }
+static inline Color4 color4_lerp(Color4 a, Color4 b, float t) { return _mm_add_ps(a, _mm_mul_ps(_mm_sub_ps(b, a), _mm_set1_ps(t))); }
+static inline float color4_alpha(Color4 c) { return _mm_cvtss_f32(_mm_shuffle_ps(c, c, _MM_SHUFFLE(3, 3, 3, 3))); }
+
+static inline Color4 color4_unpack(uint32_t rgba)
+{
+    __m128i zero = _mm_setzero_si128();
+    __m128i v = _mm_cvtsi32_si128((int)rgba);
+    v = _mm_unpacklo_epi8(v, zero);
+    v = _mm_unpacklo_epi16(v, zero);
+    return _mm_cvtepi32_ps(v);
+}
+
+static inline uint32_t color4_pack(Color4 c)
+{
+    __m128i v = _mm_cvtps_epi32(c);
+    v = _mm_packs_epi32(v, v);
+    v = _mm_packus_epi16(v, v);
+    return (uint32_t)_mm_cvtsi128_si32(v);
+}
+
+// Four adjacent pixels, one channel per register.
+struct Color4x4
+{
+    __m128 r, g, b, a;
+};
+
+static inline Color4x4 color4x4_splat(Color4 c)
+{
+    Color4x4 result;
+    result.r = _mm_shuffle_ps(c, c, _MM_SHUFFLE(0, 0, 0, 0));
+    result.g = _mm_shuffle_ps(c, c, _MM_SHUFFLE(1, 1, 1, 1));
+    result.b = _mm_shuffle_ps(c, c, _MM_SHUFFLE(2, 2, 2, 2));
+    result.a = _mm_shuffle_ps(c, c, _MM_SHUFFLE(3, 3, 3, 3));
+    return result;
+}
+
+static inline Color4x4 color4x4_add(Color4x4 a, Color4x4 b)
+{
+    a.r = _mm_add_ps(a.r, b.r);
+    a.g = _mm_add_ps(a.g, b.g);
+    a.b = _mm_add_ps(a.b, b.b);
+    a.a = _mm_add_ps(a.a, b.a);
+    return a;
+}
+
+static inline Color4x4 color4x4_mul(Color4x4 a, Color4x4 b)
+{
+    a.r = _mm_mul_ps(a.r, b.r);
+    a.g = _mm_mul_ps(a.g, b.g);
+    a.b = _mm_mul_ps(a.b, b.b);
+    a.a = _mm_mul_ps(a.a, b.a);
+    return a;
+}
+
+static inline Color4x4 color4x4_scale(Color4x4 a, __m128 s)
+{
+    a.r = _mm_mul_ps(a.r, s);
+    a.g = _mm_mul_ps(a.g, s);
+    a.b = _mm_mul_ps(a.b, s);
+    a.a = _mm_mul_ps(a.a, s);
+    return a;
+}
+
+static inline Color4x4 color4x4_lerp(Color4x4 a, Color4x4 b, __m128 t)
+{
+    a.r = _mm_add_ps(a.r, _mm_mul_ps(_mm_sub_ps(b.r, a.r), t));
+    a.g = _mm_add_ps(a.g, _mm_mul_ps(_mm_sub_ps(b.g, a.g), t));
+    a.b = _mm_add_ps(a.b, _mm_mul_ps(_mm_sub_ps(b.b, a.b), t));
+    a.a = _mm_add_ps(a.a, _mm_mul_ps(_mm_sub_ps(b.a, a.a), t));
+    return a;
+}
+
+static inline Color4x4 color4x4_unpack(__m128i rgba)
+{
+    __m128i mask = _mm_set1_epi32(0xff);
+    Color4x4 c;
+    c.r = _mm_cvtepi32_ps(_mm_and_si128(rgba, mask));
+    c.g = _mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(rgba, 8), mask));
+    c.b = _mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(rgba, 16), mask));
+    c.a = _mm_cvtepi32_ps(_mm_srli_epi32(rgba, 24));
+    return c;
+}
+
+// Saturates like color4_pack, then interleaves the channels back into RGBA.
+static inline __m128i color4x4_pack(Color4x4 c)
+{
+    __m128i rg = _mm_packs_epi32(_mm_cvtps_epi32(c.r), _mm_cvtps_epi32(c.g));
+    __m128i ba = _mm_packs_epi32(_mm_cvtps_epi32(c.b), _mm_cvtps_epi32(c.a));
+    rg = _mm_unpacklo_epi16(rg, _mm_srli_si128(rg, 8));
+    ba = _mm_unpacklo_epi16(ba, _mm_srli_si128(ba, 8));
+    __m128i bytes = _mm_packus_epi16(rg, ba);
+    return _mm_unpacklo_epi16(bytes, _mm_srli_si128(bytes, 8));
+}
+
+static inline __m128 floor4(__m128 x)
+{
+    __m128 t = _mm_cvtepi32_ps(_mm_cvttps_epi32(x));
+    return _mm_sub_ps(t, _mm_and_ps(_mm_cmpgt_ps(t, x), _mm_set1_ps(1.0f)));
+}
+
+#else
+
+struct Color4
+{
+    float e[4];
+};
+
+static inline Color4 color4(float r, float g, float b, float a)
+{
+    Color4 c = {{r, g, b, a}};
+    return c;
+}
+
+static inline Color4 color4_add(Color4 a, Color4 b)
+{
+    for (int i = 0; i < 4; i++)
+        a.e[i] += b.e[i];
+    return a;
+}
+
+static inline Color4 color4_mul(Color4 a, Color4 b)
+{
+    for (int i = 0; i < 4; i++)
+        a.e[i] *= b.e[i];
+    return a;
+}
+
+static inline Color4 color4_scale(Color4 a, float s)
+{
+    for (int i = 0; i < 4; i++)
+        a.e[i] *= s;
+    return a;
+}
+
+static inline Color4 color4_lerp(Color4 a, Color4 b, float t)
+{
+    for (int i = 0; i < 4; i++)
+        a.e[i] += (b.e[i] - a.e[i]) * t;
+    return a;
+}
+
+static inline float color4_alpha(Color4 c) { return c.e[3]; }
+
+static inline Color4 color4_unpack(uint32_t rgba)
+{
+    return color4((float)(rgba & 0xff), (float)((rgba >> 8) & 0xff),
+                  (float)((rgba >> 16) & 0xff), (float)(rgba >> 24));
+}
+
+static inline uint32_t color4_pack(Color4 c)
+{
+    uint32_t result = 0;
+    for (int i = 0; i < 4; i++)
+    {
+        float v = c.e[i] + 0.5f;
+        if (v < 0)
+            v = 0;
+        if (v > 255)
+            v = 255;
+        result |= (uint32_t)v << (8 * i);
+    }
+    return result;
+}
+
+#endif
+
+struct Software_Texture
+{
+    int width;
+    int height;
+    uint32_t *texels;
+
+    // width - 1 and height - 1 for power-of-two textures, else 0.
+    int wrap_mask_x;
+    int wrap_mask_y;
+};
+
+struct Software_Vertex
+{
+    float x, y;
+    float u, v;
+    Color4 color;
+};
+
+struct Software_GL
+{
+    bool enabled;
+
+    int width;
+    int height;
+    uint32_t *framebuffer;
+
+    Color4 clear_color;
+    bool texture_2d;
+    bool blend;
+
+    float ortho_left;
+    float ortho_right;
+    float ortho_bottom;
+    float ortho_top;
+
+    Color4 color;
+    float u, v;
+
+    GLuint bound_texture;
+    GLuint texture_capacity;
+    Software_Texture *textures;
+    GLuint next_texture_id;
+
+    int vertex_count;
+    int vertex_capacity;
+    Software_Vertex *vertices;
+
+    struct Client_Array
+    {
+        bool enabled;
+        GLint size;
+        GLenum type;
+        GLsizei stride;
+        const uint8_t *pointer;
+    } vertex_array, texcoord_array, color_array;
+
+    Software_Render_Stats stats;
+};
+
+static Software_GL sgl = {};
+
+void software_render_init(int width, int height)
+{
+    sgl.enabled = true;
+    sgl.width = width;
+    sgl.height = height;
+    sgl.framebuffer = (uint32_t *)calloc((size_t)width * height, sizeof(uint32_t));
+    sgl.ortho_left = -1;
+    sgl.ortho_right = 1;
+    sgl.ortho_bottom = -1;
+    sgl.ortho_top = 1;
+    sgl.color = color4(255, 255, 255, 255);
+}
+
+void software_render_end_frame()
+{
+    sgl.stats.frames++;
+}
+
+Software_Render_Stats software_render_get_stats()
+{
+    return sgl.stats;
+}
+
+uint32_t *software_render_get_framebuffer(int *width, int *height)
+{
+    *width = sgl.width;
+    *height = sgl.height;
+    return sgl.framebuffer;
+}
+
+bool software_render_write_ppm(const char *filename)
+{
+    if (!sgl.framebuffer)
+        return false;
+
+    FILE *file = fopen(filename, "wb");
+    if (!file)
+        return false;
+
+    fprintf(file, "P6\n%d %d\n255\n", sgl.width, sgl.height);
+    for (int i = 0; i < sgl.width * sgl.height; i++)
+    {
+        uint32_t p = sgl.framebuffer[i];
+        uint8_t rgb[3] = {(uint8_t)p, (uint8_t)(p >> 8), (uint8_t)(p >> 16)};
+        fwrite(rgb, 1, 3, file);
+    }
+
+    fclose(file);
+    return true;
+}
+
+// rasterization
+
+static inline int wrap_texel(int i, int n)
+{
+    i %= n;
+    return i < 0 ? i + n : i;
+}
+
+// The 2x2 texel footprint whose top-left texel is (x, y), with GL_REPEAT.
+static inline void wrap_texels(Software_Texture *texture, int x, int y, int *x0, int *x1, int *y0, int *y1)
+{
+    if (texture->wrap_mask_x && texture->wrap_mask_y)
+    {
+        *x0 = x & texture->wrap_mask_x;
+        *x1 = (*x0 + 1) & texture->wrap_mask_x;
+        *y0 = y & texture->wrap_mask_y;
+        *y1 = (*y0 + 1) & texture->wrap_mask_y;
+    }
+    else
+    {
+        *x0 = wrap_texel(x, texture->width);
+        *x1 = wrap_texel(*x0 + 1, texture->width);
+        *y0 = wrap_texel(y, texture->height);
+        *y1 = wrap_texel(*y0 + 1, texture->height);
+    }
+}
+
+static Color4 sample_bilinear(Software_Texture *texture, float u, float v)
+{
+    float x = u * texture->width - 0.5f;
+    float y = v * texture->height - 0.5f;
+    float fx0 = floorf(x);
+    float fy0 = floorf(y);
+    float tx = x - fx0;
+    float ty = y - fy0;
+
+    int x0, x1, y0, y1;
+    wrap_texels(texture, (int)fx0, (int)fy0, &x0, &x1, &y0, &y1);
+
+    uint32_t *row0 = texture->texels + y0 * texture->width;
+    uint32_t *row1 = texture->texels + y1 * texture->width;
+
+    Color4 top = color4_lerp(color4_unpack(row0[x0]), color4_unpack(row0[x1]), tx);
+    Color4 bottom = color4_lerp(color4_unpack(row1[x0]), color4_unpack(row1[x1]), tx);
+    return color4_lerp(top, bottom, ty);
+}
+
+#if HEADLESS_GL_SSE2
+
+// sample_bilinear for four pixels. Texel addresses are computed and fetched
+// per lane; the filtering is done a channel at a time.
+static Color4x4 sample_bilinear4(Software_Texture *texture, __m128 u, __m128 v)
+{
+    __m128 half = _mm_set1_ps(0.5f);
+    __m128 x = _mm_sub_ps(_mm_mul_ps(u, _mm_set1_ps((float)texture->width)), half);
+    __m128 y = _mm_sub_ps(_mm_mul_ps(v, _mm_set1_ps((float)texture->height)), half);
+    __m128 fx0 = floor4(x);
+    __m128 fy0 = floor4(y);
+    __m128 tx = _mm_sub_ps(x, fx0);
+    __m128 ty = _mm_sub_ps(y, fy0);
+
+    int ix[4], iy[4];
+    _mm_storeu_si128((__m128i *)ix, _mm_cvttps_epi32(fx0));
+    _mm_storeu_si128((__m128i *)iy, _mm_cvttps_epi32(fy0));
+
+    uint32_t t00[4], t01[4], t10[4], t11[4];
+    for (int i = 0; i < 4; i++)
+    {
+        int x0, x1, y0, y1;
+        wrap_texels(texture, ix[i], iy[i], &x0, &x1, &y0, &y1);
+        uint32_t *row0 = texture->texels + y0 * texture->width;
+        uint32_t *row1 = texture->texels + y1 * texture->width;
+        t00[i] = row0[x0];
+        t01[i] = row0[x1];
+        t10[i] = row1[x0];
+        t11[i] = row1[x1];
+    }
+
+    Color4x4 top = color4x4_lerp(color4x4_unpack(_mm_loadu_si128((__m128i *)t00)),
+                                 color4x4_unpack(_mm_loadu_si128((__m128i *)t01)), tx);
+    Color4x4 bottom = color4x4_lerp(color4x4_unpack(_mm_loadu_si128((__m128i *)t10)),
+                                    color4x4_unpack(_mm_loadu_si128((__m128i *)t11)), tx);
+    return color4x4_lerp(top, bottom, ty);
+}
+
+#endif
+
+// Edge function A*x + B*y + C, positive inside the triangle. Shared edges are
+// computed from the same canonical vertex order so neighbouring triangles get
+// exactly negated functions, and the tie-break below assigns boundary pixels
+// to exactly one of them.
+struct Edge
+{
+    float a, b, c;
+    bool inclusive;
+};
+
+static Edge make_edge(const Software_Vertex *p, const Software_Vertex *q)
+{
+    bool swap = (p->x > q->x) || (p->x == q->x && p->y > q->y);
+    const Software_Vertex *s = swap ? q : p;
+    const Software_Vertex *t = swap ? p : q;
+
+    Edge e;
+    e.a = -(t->y - s->y);
+    e.b = t->x - s->x;
+    e.c = -(e.a * s->x + e.b * s->y);
+    if (swap)
+    {
+        e.a = -e.a;
+        e.b = -e.b;
+        e.c = -e.c;
+    }
+    return e;
+}
+
+// Narrows [*x0, *x1] to the pixels on the row at pixel-center height y whose
+// centers pass the edge test.
+static void clip_span(Edge *e, float y, int *x0, int *x1)
+{
+    float offset = e->b * y + e->c;
+    if (e->a == 0)
+    {
+        if (e->inclusive ? offset < 0 : offset <= 0)
+        {
+            *x1 = *x0 - 1;
+        }
+        return;
+    }
+
+    float t = -offset / e->a - 0.5f;
+    if (e->a > 0)
+    {
+        int first = e->inclusive ? (int)ceilf(t) : (int)floorf(t) + 1;
+        if (first > *x0)
+            *x0 = first;
+    }
+    else
+    {
+        int last = e->inclusive ? (int)floorf(t) : (int)ceilf(t) - 1;
+        if (last < *x1)
+            *x1 = last;
+    }
+}
+
+static void rasterize_triangle(Software_Vertex *v0, Software_Vertex *v1, Software_Vertex *v2)
+{
+    Edge edges[3] = {make_edge(v1, v2), make_edge(v2, v0), make_edge(v0, v1)};
+
+    float area = edges[2].a * v2->x + edges[2].b * v2->y + edges[2].c;
+    if (area == 0)
+        return;
+    if (area < 0)
+    {
+        area = -area;
+        for (int i = 0; i < 3; i++)
+        {
+            edges[i].a = -edges[i].a;
+            edges[i].b = -edges[i].b;
+            edges[i].c = -edges[i].c;
+        }
+    }
+    for (int i = 0; i < 3; i++)
+    {
+        edges[i].inclusive = edges[i].a > 0 || (edges[i].a == 0 && edges[i].b > 0);
+    }
+
+    // Attributes are planes over screen space: value = k + gx * x + gy * y,
+    // built from the barycentric weights l1 = edges[1] / area, l2 = edges[2] / area.
+    float inv_area = 1.0f / area;
+    float l1x = edges[1].a * inv_area, l1y = edges[1].b * inv_area, l1c = edges[1].c * inv_area;
+    float l2x = edges[2].a * inv_area, l2y = edges[2].b * inv_area, l2c = edges[2].c * inv_area;
+
+    float du1 = v1->u - v0->u, du2 = v2->u - v0->u;
+    float dv1 = v1->v - v0->v, dv2 = v2->v - v0->v;
+    float u_gx = du1 * l1x + du2 * l2x;
+    float u_gy = du1 * l1y + du2 * l2y;
+    float u_k = v0->u + du1 * l1c + du2 * l2c;
+    float v_gx = dv1 * l1x + dv2 * l2x;
+    float v_gy = dv1 * l1y + dv2 * l2y;
+    float v_k = v0->v + dv1 * l1c + dv2 * l2c;
+
+    Color4 dc1 = color4_add(v1->color, color4_scale(v0->color, -1));
+    Color4 dc2 = color4_add(v2->color, color4_scale(v0->color, -1));
+    Color4 c_gx = color4_add(color4_scale(dc1, l1x), color4_scale(dc2, l2x));
+    Color4 c_gy = color4_add(color4_scale(dc1, l1y), color4_scale(dc2, l2y));
+    Color4 c_k = color4_add(v0->color, color4_add(color4_scale(dc1, l1c), color4_scale(dc2, l2c)));
+
+    Software_Texture *texture = NULL;
+    if (sgl.texture_2d && sgl.bound_texture < sgl.texture_capacity &&
+        sgl.textures[sgl.bound_texture].texels)
+    {
+        texture = &sgl.textures[sgl.bound_texture];
+    }
+
+    float min_y = fminf(v0->y, fminf(v1->y, v2->y));
+    float max_y = fmaxf(v0->y, fmaxf(v1->y, v2->y));
+    int y_first = (int)ceilf(min_y - 0.5f);
+    int y_last = (int)floorf(max_y - 0.5f);
+    if (y_first < 0)
+        y_first = 0;
+    if (y_last > sgl.height - 1)
+        y_last = sgl.height - 1;
+
+    const float inv_255 = 1.0f / 255.0f;
+
+    // Triangles whose texture coordinates do not vary, such as vertex-colored
+    // quads mapped to a single white texel, sample once per triangle.
+    bool constant_texel = false;
+    Color4 texel = color4(255, 255, 255, 255);
+    if (texture && u_gx == 0 && u_gy == 0 && v_gx == 0 && v_gy == 0)
+    {
+        constant_texel = true;
+        texel = sample_bilinear(texture, v0->u, v0->v);
+        texture = NULL;
+    }
+
+    for (int y = y_first; y <= y_last; y++)
+    {
+        float yc = y + 0.5f;
+        int x0 = 0;
+        int x1 = sgl.width - 1;
+        for (int i = 0; i < 3; i++)
+        {
+            clip_span(&edges[i], yc, &x0, &x1);
+        }
+        if (x0 > x1)
+            continue;
+
+        sgl.stats.pixels += x1 - x0 + 1;
+
+        float xc = x0 + 0.5f;
+        Color4 c = color4_add(c_k, color4_add(color4_scale(c_gx, xc), color4_scale(c_gy, yc)));
+        float u = u_k + u_gx * xc + u_gy * yc;
+        float v = v_k + v_gx * xc + v_gy * yc;
+
+        uint32_t *pixel = sgl.framebuffer + y * sgl.width + x0;
+        int x = x0;
+
+#if HEADLESS_GL_SSE2
+        if (x1 - x0 + 1 >= 4)
+        {
+            __m128 lane = _mm_setr_ps(0, 1, 2, 3);
+            __m128 four = _mm_set1_ps(4);
+            __m128 scale = _mm_set1_ps(inv_255);
+
+            Color4x4 c_step = color4x4_splat(c_gx);
+            Color4x4 c4 = color4x4_add(color4x4_splat(c), color4x4_scale(c_step, lane));
+            c_step = color4x4_scale(c_step, four);
+            __m128 u4 = _mm_add_ps(_mm_set1_ps(u), _mm_mul_ps(_mm_set1_ps(u_gx), lane));
+            __m128 v4 = _mm_add_ps(_mm_set1_ps(v), _mm_mul_ps(_mm_set1_ps(v_gx), lane));
+            __m128 u_step = _mm_set1_ps(4 * u_gx);
+            __m128 v_step = _mm_set1_ps(4 * v_gx);
+            Color4x4 texel4 = color4x4_splat(texel);
+
+            for (; x + 3 <= x1; x += 4, pixel += 4)
+            {
+                Color4x4 src = c4;
+                if (texture)
+                {
+                    src = color4x4_scale(color4x4_mul(sample_bilinear4(texture, u4, v4), c4), scale);
+                }
+                else if (constant_texel)
+                {
+                    src = color4x4_scale(color4x4_mul(texel4, c4), scale);
+                }
+
+                if (sgl.blend)
+                {
+                    __m128 alpha = _mm_mul_ps(src.a, scale);
+                    src = color4x4_lerp(color4x4_unpack(_mm_loadu_si128((__m128i *)pixel)), src, alpha);
+                }
+
+                _mm_storeu_si128((__m128i *)pixel, color4x4_pack(src));
+
+                c4 = color4x4_add(c4, c_step);
+                u4 = _mm_add_ps(u4, u_step);
+                v4 = _mm_add_ps(v4, v_step);
+            }
+
+            xc = x + 0.5f;
+            c = color4_add(c_k, color4_add(color4_scale(c_gx, xc), color4_scale(c_gy, yc)));
+            u = u_k + u_gx * xc + u_gy * yc;
+            v = v_k + v_gx * xc + v_gy * yc;
+        }
+#endif
+
+        for (; x <= x1; x++, pixel++)
+        {
+            Color4 src = c;
+            if (texture)
+            {
+                src = color4_scale(color4_mul(sample_bilinear(texture, u, v), c), inv_255);
+            }
+            else if (constant_texel)
+            {
+                src = color4_scale(color4_mul(texel, c), inv_255);
+            }
+
+            if (sgl.blend)
+            {
+                float alpha = color4_alpha(src) * inv_255;
+                src = color4_lerp(color4_unpack(*pixel), src, alpha);
+            }
+
+            *pixel = color4_pack(src);
+
+            c = color4_add(c, c_gx);
+            u += u_gx;
+            v += v_gx;
+        }
+    }
+
+    sgl.stats.triangles++;
+}
+
+// GL entry points
+
+void glClearColor(GLclampf red, GLclampf green, GLclampf blue, GLclampf alpha)
+{
+    sgl.clear_color = color4(red * 255, green * 255, blue * 255, alpha * 255);
+}
+
+void glClear(GLbitfield mask)
+{
+    if (!sgl.enabled || !(mask & GL_COLOR_BUFFER_BIT))
+        return;
+
+    double start = get_time();
+
+    uint32_t value = color4_pack(sgl.clear_color);
+    int count = sgl.width * sgl.height;
+    int i = 0;
+#if HEADLESS_GL_SSE2
+    __m128i wide = _mm_set1_epi32((int)value);
+    for (; i + 4 <= count; i += 4)
+    {
+        _mm_storeu_si128((__m128i *)(sgl.framebuffer + i), wide);
+    }
+#endif
+    for (; i < count; i++)
+    {
+        sgl.framebuffer[i] = value;
+    }
+
+    sgl.stats.seconds += get_time() - start;
+}
+
+void glEnable(GLenum cap)
+{
+    if (cap == GL_TEXTURE_2D)
+        sgl.texture_2d = true;
+    if (cap == GL_BLEND)
+        sgl.blend = true;
+}
+
+void glDisable(GLenum cap)
+{
+    if (cap == GL_TEXTURE_2D)
+        sgl.texture_2d = false;
+    if (cap == GL_BLEND)
+        sgl.blend = false;
+}
+
+// Only SRC_ALPHA, ONE_MINUS_SRC_ALPHA blending is implemented.
+void glBlendFunc(GLenum sfactor, GLenum dfactor) {}
+
+void glOrtho(GLdouble left, GLdouble right, GLdouble bottom, GLdouble top, GLdouble near_val, GLdouble far_val)
+{
+    sgl.ortho_left = (float)left;
+    sgl.ortho_right = (float)right;
+    sgl.ortho_bottom = (float)bottom;
+    sgl.ortho_top = (float)top;
+}
+
+void glGenTextures(GLsizei n, GLuint *textures)
+{
+    for (GLsizei i = 0; i < n; i++)
+    {
+        textures[i] = ++sgl.next_texture_id;
+    }
+}
+
+void glBindTexture(GLenum target, GLuint texture)
+{
+    sgl.bound_texture = texture;
+}
+
+void glTexImage2D(GLenum target, GLint level, GLint internalFormat, GLsizei width, GLsizei height, GLint border, GLenum format, GLenum type, const GLvoid *pixels)
+{
+    GLuint id = sgl.bound_texture;
+    if (!sgl.enabled || id == 0 || level != 0 || format != GL_RGBA || type != GL_UNSIGNED_BYTE)
+        return;
+
+    if (id >= sgl.texture_capacity)
+    {
+        GLuint capacity = id * 2;
+        sgl.textures = (Software_Texture *)realloc(sgl.textures, capacity * sizeof(Software_Texture));
+        memset(sgl.textures + sgl.texture_capacity, 0, (capacity - sgl.texture_capacity) * sizeof(Software_Texture));
+        sgl.texture_capacity = capacity;
+    }
+
+    Software_Texture *texture = &sgl.textures[id];
+    size_t bytes = (size_t)width * height * sizeof(uint32_t);
+    texture->width = width;
+    texture->height = height;
+    texture->wrap_mask_x = (width & (width - 1)) == 0 ? width - 1 : 0;
+    texture->wrap_mask_y = (height & (height - 1)) == 0 ? height - 1 : 0;
+    texture->texels = (uint32_t *)realloc(texture->texels, bytes);
+    if (pixels)
+        memcpy(texture->texels, pixels, bytes);
+    else
+        memset(texture->texels, 0, bytes);
+}
+
+void glTexSubImage2D(GLenum target, GLint level, GLint xoffset, GLint yoffset, GLsizei width, GLsizei height, GLenum format, GLenum type, const GLvoid *pixels)
+{
+    GLuint id = sgl.bound_texture;
+    if (!sgl.enabled || id == 0 || id >= sgl.texture_capacity || level != 0 ||
+        format != GL_RGBA || type != GL_UNSIGNED_BYTE || !pixels)
+        return;
+
+    Software_Texture *texture = &sgl.textures[id];
+    if (xoffset < 0 || yoffset < 0 || width < 0 || height < 0 ||
+        xoffset + width > texture->width || yoffset + height > texture->height)
+        return;
+
+    const uint32_t *src = (const uint32_t *)pixels;
+    for (GLsizei row = 0; row < height; row++)
+    {
+        memcpy(texture->texels + (size_t)(yoffset + row) * texture->width + xoffset,
+               src + (size_t)row * width, (size_t)width * sizeof(uint32_t));
+    }
+}
+
+void glTexParameterf(GLenum target, GLenum pname, GLfloat param) {}
+
+void glBegin(GLenum mode)
+{
+    sgl.vertex_count = 0;
+}
+
+
+void glColor3f(GLfloat red, GLfloat green, GLfloat blue)
+{
+    sgl.color = color4(red * 255, green * 255, blue * 255, 255);
+}
+
+void glColor4f(GLfloat red, GLfloat green, GLfloat blue, GLfloat alpha)
+{
+    sgl.color = color4(red * 255, green * 255, blue * 255, alpha * 255);
+}
+
+void glTexCoord2f(GLfloat s, GLfloat t)
+{
+    sgl.u = s;
+    sgl.v = t;
+}
+
+static void push_vertex(float x, float y, float u, float v, Color4 color)
+{
+    if (sgl.vertex_count == sgl.vertex_capacity)
+    {
+        sgl.vertex_capacity = sgl.vertex_capacity ? sgl.vertex_capacity * 2 : 1024;
+        sgl.vertices = (Software_Vertex *)realloc(sgl.vertices, sgl.vertex_capacity * sizeof(Software_Vertex));
+    }
+
+    Software_Vertex *vertex = &sgl.vertices[sgl.vertex_count++];
+    vertex->x = (x - sgl.ortho_left) / (sgl.ortho_right - sgl.ortho_left) * sgl.width;
+    vertex->y = (sgl.ortho_top - y) / (sgl.ortho_top - sgl.ortho_bottom) * sgl.height;
+    vertex->u = u;
+    vertex->v = v;
+    vertex->color = color;
+}
+
+static void rasterize_vertices()
+{
+    double start = get_time();
+
+    for (int i = 0; i + 3 <= sgl.vertex_count; i += 3)
+    {
+        rasterize_triangle(&sgl.vertices[i], &sgl.vertices[i + 1], &sgl.vertices[i + 2]);
+    }
+    sgl.vertex_count = 0;
+
+    sgl.stats.seconds += get_time() - start;
+}
+
+void glVertex3f(GLfloat x, GLfloat y, GLfloat z)
+{
+    if (!sgl.enabled)
+        return;
+
+    push_vertex(x, y, sgl.u, sgl.v, sgl.color);
+}
+
+// client-side vertex arrays
+
+static Software_GL::Client_Array *client_array(GLenum array)
+{
+    switch (array)
+    {
+        case GL_VERTEX_ARRAY:
+            return &sgl.vertex_array;
+        case GL_TEXTURE_COORD_ARRAY:
+            return &sgl.texcoord_array;
+        case GL_COLOR_ARRAY:
+            return &sgl.color_array;
+    }
+    return NULL;
+}
+
+static void set_client_array(Software_GL::Client_Array *array, GLint size, GLenum type, GLsizei stride, const GLvoid *pointer, int element_size)
+{
+    array->size = size;
+    array->type = type;
+    array->stride = stride ? stride : size * element_size;
+    array->pointer = (const uint8_t *)pointer;
+}
+
+void glEnableClientState(GLenum array)
+{
+    Software_GL::Client_Array *a = client_array(array);
+    if (a)
+        a->enabled = true;
+}
+
+void glDisableClientState(GLenum array)
+{
+    Software_GL::Client_Array *a = client_array(array);
+    if (a)
+        a->enabled = false;
+}
+
+// Positions and texture coordinates must be GL_FLOAT; colors may be GL_FLOAT
+// or GL_UNSIGNED_BYTE.
+void glVertexPointer(GLint size, GLenum type, GLsizei stride, const GLvoid *pointer)
+{
+    set_client_array(&sgl.vertex_array, size, type, stride, pointer, sizeof(float));
+}
+
+void glTexCoordPointer(GLint size, GLenum type, GLsizei stride, const GLvoid *pointer)
+{
+    set_client_array(&sgl.texcoord_array, size, type, stride, pointer, sizeof(float));
+}
+
+void glColorPointer(GLint size, GLenum type, GLsizei stride, const GLvoid *pointer)
+{
+    set_client_array(&sgl.color_array, size, type, stride, pointer,
+                     type == GL_UNSIGNED_BYTE ? 1 : sizeof(float));
+}
+
+void glDrawArrays(GLenum mode, GLint first, GLsizei count)
+{
+    if (!sgl.enabled || mode != GL_TRIANGLES || !sgl.vertex_array.enabled ||
+        sgl.vertex_array.type != GL_FLOAT)
+        return;
+
+    Software_GL::Client_Array *va = &sgl.vertex_array;
+    Software_GL::Client_Array *ta = &sgl.texcoord_array;
+    Software_GL::Client_Array *ca = &sgl.color_array;
+    bool use_texcoords = ta->enabled && ta->type == GL_FLOAT;
+
+    for (GLint i = first; i < first + count; i++)
+    {
+        const float *position = (const float *)(va->pointer + i * va->stride);
+
+        float u = sgl.u;
+        float v = sgl.v;
+        if (use_texcoords)
+        {
+            const float *texcoord = (const float *)(ta->pointer + i * ta->stride);
+            u = texcoord[0];
+            v = texcoord[1];
+        }
+
+        Color4 color = sgl.color;
+        if (ca->enabled)
+        {
+            const uint8_t *c = ca->pointer + i * ca->stride;
+            if (ca->type == GL_UNSIGNED_BYTE)
+            {
+                color = color4(c[0], c[1], c[2], ca->size == 4 ? c[3] : 255);
+            }
+            else
+            {
+                const float *f = (const float *)c;
+                color = color4(f[0] * 255, f[1] * 255, f[2] * 255, ca->size == 4 ? f[3] * 255 : 255);
+            }
+        }
+
+        push_vertex(position[0], position[1], u, v, color);
+    }
+
+    rasterize_vertices();
+}
+
+void glEnd()
+{
+    if (!sgl.enabled)
+        return;
+
+    rasterize_vertices();
+}
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <stdint.h>
+
+// Software implementation of the fixed-function GL subset the game uses.
+// Until software_render_init is called every GL entry point is a no-op, so
+// headless runs that do not need pixels pay nothing for drawing.
+
+struct Software_Render_Stats
+{
+    int frames;
+    int64_t triangles;
+    int64_t pixels;
+    double seconds;
+};
+
+void software_render_init(int width, int height);
+void software_render_end_frame();
+Software_Render_Stats software_render_get_stats();
+
+// Framebuffer is width * height RGBA8 pixels, top row first.
+uint32_t *software_render_get_framebuffer(int *width, int *height);
+bool software_render_write_ppm(const char *filename);
@@ -1,9 +1,30 @@
 #include <stdint.h>
+#include <stdio.h>
 #include <math.h>
 #include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include <float.h>
+#include <atomic>
+#include <thread>
+#ifdef _WIN32
 #include <windows.h>
+#endif
 #include <GL/gl.h>
 #include "invaders.h"
+#include "atlas.h"
+#include "asset-pack.h"
+#include "profiler.h"
+#include "jobs.h"
+#include "rng.h"
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#define INVADERS_AVX 1
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define INVADERS_SSE2 1
+#endif
 
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
@@ -12,24 +33,29 @@ const float TAU = 6.28318530717958646f;
 
 // Globals
 
-int key_left = 0;
-int key_right = 0;
-int key_up = 0;
-int key_down = 0;
-
 bool should_quit_game = false;
 
-float current_dt = 1.0f / 60.0f;
 double last_time = 0;
 
+// The simulation advances in fixed ticks of tick_dt. Frames accumulate
+// wall-clock time and run the ticks it covers; drawing interpolates between
+// the last two ticks by render_alpha.
+float tick_dt = 1.0f / 120.0f;
+const int max_ticks_per_frame = 8;
+double tick_accumulator = 0;
+float render_alpha = 1.0f;
+
+// When positive, invaders_simulate advances by this instead of the wall-clock delta.
+float fixed_dt = 0;
+
 const float live_y_max = 1.0f;
 const float live_y_min = -0.1f;
 
-const int num_desired_invaders = 15;
+const int explosion_burst = 48;
+const int ship_hit_burst = 16;
 const float INVADER_RADIUS = 0.03f;
-
-int num_shots_fired = 0;
-int num_invaders_destroyed = 0;
+const float SHIP_RADIUS = 0.025f;
+const float PROJECTILE_RADIUS = 0.006f;
 
 struct Bitmap
 {
@@ -37,6 +63,11 @@ struct Bitmap
     int height;
     uint8_t *data;
     uint32_t id;
+
+    // The part of texture id this bitmap occupies: all of it for a
+    // standalone texture, one rect for an atlas entry.
+    float u0, v0;
+    float u1, v1;
 };
 
 struct Vector2
@@ -57,27 +88,71 @@ struct Vector4
 struct Invader
 {
     Vector2 position;
+    Vector2 previous_position;
     Vector2 velocity;
 
     Vector2 target_position;
     Bitmap *bitmap;
 
     float sleep_countdown;
+    float fire_countdown;
+    bool destroyed;
+
+    uint32_t id;
 };
 
-struct Particle
+// All live particles share one pool, stored as one stream per field so
+// sim_particles can integrate a whole SIMD register of them at a time.
+// Live particles are packed into [0, count); each one records the index of
+// the emitter that owns it.
+struct Particle_Pool
 {
-    Vector2 position;
-    Vector2 velocity;
+    int count;
+    int capacity;
+
+    float *position_x;
+    float *position_y;
+    float *velocity_x;
+    float *velocity_y;
+    float *drag;
+    float *elapsed;
+
+    float *lifetime;
+    float *size;
+    Vector4 *color;
+    int *emitter;
+
+    void *memory; // the block all streams live in
+};
 
-    float size;
-    float lifetime;
-    float drag;
-    float elapsed;
-    Vector4 color;
+// Invader projectiles, stored like particles so sim_projectiles can move a
+// register of them at a time and test it against the ship in the same pass.
+// Live projectiles are packed into [0, count). A projectile with a contrail
+// records the index of the emitter trailing it, and the emitter records the
+// projectile's index back; the others hold -1.
+struct Projectile_Pool
+{
+    int count;
+    int capacity;
+
+    float *position_x;
+    float *position_y;
+    float *velocity_x;
+    float *velocity_y;
+    int *emitter;
+
+    // Written by the parallel pass each tick, read by the serial one.
+    uint8_t *fate;
+
+    void *memory;
 };
 
-const int particle_max = 200;
+enum Projectile_Fate
+{
+    PROJECTILE_LIVE,
+    PROJECTILE_GONE,      // left the playfield
+    PROJECTILE_NEAR_SHIP, // inside the ship's box; the serial pass decides
+};
 
 struct Bullet;
 
@@ -87,7 +162,6 @@ struct Particle_Emitter
     Vector2 velocity;
 
     int particle_count;
-    Particle particles[particle_max];
     float fadeout_period;
     float particles_per_second;
 
@@ -114,6 +188,10 @@ struct Particle_Emitter
     float elapsed;
     float remainder;
 
+    uint32_t id;
+    int live_index;
+    int projectile; // the projectile this emitter trails, or -1
+
     bool producing;
     bool alive;
 };
@@ -121,66 +199,151 @@ struct Particle_Emitter
 struct Bullet
 {
     Vector2 position;
+    Vector2 previous_position;
     Vector2 velocity;
     Vector4 color;
     Particle_Emitter *emitter;
 };
 
-int bullet_count = 0;
-const int bullet_max = 200;
-Bullet bullets[bullet_max];
+// Uniform grid over the [0,1] playfield used as the bullet-vs-invader
+// broad-phase. Invaders are binned once per frame with a counting sort, so
+// each cell holds a contiguous run of invader indices in ascending order.
+// Positions outside the playfield are clamped into the border cells.
+struct Invader_Grid
+{
+    int cells_per_side;
+    int cell_capacity;
+    int item_capacity;
 
-int live_invader_count = 0;
-const int live_invader_max = 100;
-Invader live_invaders[live_invader_max];
+    int *cell_start; // cells + 1 entries; cell c is items [cell_start[c], cell_start[c + 1])
+    int *cell_fill;
+    int *items;
+};
 
-int live_emitter_count = 0;
-const int emitter_max = 200;
-Particle_Emitter emitters[emitter_max];
+// Pool sizes for new worlds, and the game rules the stress scenarios vary.
+int bullet_max = 200;
+int live_invader_max = 100;
+int emitter_max = 200;
+int num_desired_invaders = 15;
+float auto_fire_rate = 0;
+int emitters_per_explosion = 1;
+
+// Snapshots store emitter slots in 16 bits.
+const int emitter_capacity_limit = 32767;
+
+// Everything the simulation changes lives in a World, so independent games
+// can run side by side (see the env batch at the end of this file). Game
+// code works on the calling thread's current world.
+struct World
+{
+    int key_left;
+    int key_right;
+    int key_up;
+    int key_down;
+
+    float current_dt;
+
+    int num_shots_fired;
+    int num_invaders_destroyed;
+    int num_ship_hits;
+
+    // Entity arrays are sized once, by alloc_world.
+    int bullet_capacity;
+    int bullet_count;
+    Bullet *bullets;
+
+    int invader_capacity;
+    int live_invader_count;
+    Invader *live_invaders;
+
+    // Per-tick results of the parallel bullet pass, committed serially.
+    int *bullet_hits;
+
+    int emitter_capacity;
+    int live_emitter_count;
+    Particle_Emitter *emitters;
+
+    // Indices into emitters[]: live_emitters is packed in [0, live_emitter_count),
+    // free_emitters is a stack of unused slots.
+    int *live_emitters;
+    int free_emitter_count;
+    int *free_emitters;
+
+    // Fraction of a volley owed to auto_fire_rate.
+    float auto_fire_remainder;
+
+    Particle_Pool particle_pool;
+    Projectile_Pool projectiles;
+    Invader_Grid invader_grid;
+
+    Vector2 ship_position;
+    Vector2 ship_previous_position;
+
+    // Random streams are keyed by the seed and numbered by entity id and
+    // tick (see rng.h). Ids are never reused within a game.
+    Rng_Key rng_key;
+    uint32_t tick;
+    uint32_t next_entity_id;
+};
 
-const int invader_bitmap_count = 4;
-Bitmap invader_bitmaps[invader_bitmap_count];
-Bitmap ship_bitmap;
-Bitmap bullet_bitmap;
-Bitmap contrail_bitmap;
+World main_world;
+thread_local World *world = &main_world;
 
-Vector2 ship_position;
+// Runs body over [0, count) on the job pool with every chunk working on the
+// caller's world.
+struct World_Job
+{
+    World *world;
+    void (*body)(int first, int end);
+};
 
-uint32_t RANDRANGE = 0x10000000;
-int32_t random_state = 0xbeefface;
+void run_world_job(void *context, int first, int end)
+{
+    World_Job *job = (World_Job *)context;
+    World *previous = world;
+    world = job->world;
+    job->body(first, end);
+    world = previous;
+}
 
-uint32_t random_get()
+void parallel_for_world(int count, int grain, void (*body)(int first, int end))
 {
-    int32_t x = random_state;
+    World_Job job = {world, body};
+    parallel_for(count, grain, run_world_job, &job);
+}
 
-    int32_t hi = x / 1277773;
-    int32_t lo = x % 1277773;
+// Chunk sizes for the parallel phases. Below one chunk a phase runs inline.
+const int particle_grain = 8192;
+const int bullet_grain = 256;
+const int invader_grain = 256;
+const int projectile_grain = 8192;
 
-    uint32_t t = 16807 * lo - 2836 * hi;
-    if (t <= 0)
-    {
-        t += 0x7fffffff;
-    }
+int particle_pool_max = 8192;
+int projectile_pool_max = 100000;
+int job_thread_count = 0;
 
-    random_state = t;
-    return (uint32_t)t;
-}
+const int invader_bitmap_count = 4;
+Bitmap invader_bitmaps[invader_bitmap_count];
+Bitmap ship_bitmap;
+Bitmap bullet_bitmap;
+Bitmap contrail_bitmap;
 
-void random_seed(int32_t new_seed)
-{
-    random_state = new_seed;
-}
+const int32_t default_random_seed = 0xbeefface;
 
-float random_get_zero_to_one()
+// What an entity's stream is for, so different draws of one entity in the
+// same tick never share numbers.
+enum Rng_Purpose
 {
-    uint32_t randint = random_get() % RANDRANGE;
-    return (float)randint / (float)RANDRANGE;
-}
+    RNG_SPAWN,
+    RNG_BEHAVIOUR,
+    RNG_PARTICLES,
+    RNG_BURST,
+    RNG_FIRE,
+};
 
-float random_get_within_range(float min, float max)
+Rng_Stream entity_stream(uint32_t id, Rng_Purpose purpose)
 {
-    float range = (max - min);
-    return min + range * random_get_zero_to_one();
+    return rng_stream(world->rng_key, id, world->tick, purpose);
 }
 
 Vector2 make_vector2(float x, float y)
@@ -210,6 +373,14 @@ Vector4 make_vector4(float x, float y, float z, float w)
     return v;
 }
 
+Vector2 lerp(Vector2 a, Vector2 b, float t)
+{
+    Vector2 r;
+    r.x = a.x + t * (b.x - a.x);
+    r.y = a.y + t * (b.y - a.y);
+    return r;
+}
+
 Vector4 lerp(Vector4 a, Vector4 b, float t)
 {
     Vector4 r;
@@ -226,70 +397,385 @@ void linear_move(Vector2 *position, Vector2 *velocity, float dt)
     position->y += velocity->y * dt;
 }
 
-Particle *spawn_particle(Particle_Emitter *emitter)
+void init_particle_pool(Particle_Pool *pool, int capacity)
+{
+    // Round up so every stream starts on a 32 byte boundary.
+    capacity = (capacity + 7) & ~7;
+
+    size_t floats = (size_t)capacity * sizeof(float);
+    size_t bytes = 8 * floats + (size_t)capacity * (sizeof(Vector4) + sizeof(int));
+    uint8_t *memory = (uint8_t *)malloc(bytes + 31);
+    uint8_t *at = (uint8_t *)(((uintptr_t)memory + 31) & ~(uintptr_t)31);
+
+    pool->memory = memory;
+    pool->count = 0;
+    pool->capacity = capacity;
+    pool->color = (Vector4 *)at;
+    at += capacity * sizeof(Vector4);
+    pool->position_x = (float *)at;
+    at += floats;
+    pool->position_y = (float *)at;
+    at += floats;
+    pool->velocity_x = (float *)at;
+    at += floats;
+    pool->velocity_y = (float *)at;
+    at += floats;
+    pool->drag = (float *)at;
+    at += floats;
+    pool->elapsed = (float *)at;
+    at += floats;
+    pool->lifetime = (float *)at;
+    at += floats;
+    pool->size = (float *)at;
+    at += floats;
+    pool->emitter = (int *)at;
+}
+
+void init_projectile_pool(Projectile_Pool *pool, int capacity)
+{
+    // Round up so every stream starts on a 32 byte boundary.
+    capacity = (capacity + 31) & ~31;
+
+    size_t floats = (size_t)capacity * sizeof(float);
+    size_t bytes = 4 * floats + (size_t)capacity * (sizeof(int) + sizeof(uint8_t));
+    uint8_t *memory = (uint8_t *)malloc(bytes + 31);
+    uint8_t *at = (uint8_t *)(((uintptr_t)memory + 31) & ~(uintptr_t)31);
+
+    pool->memory = memory;
+    pool->count = 0;
+    pool->capacity = capacity;
+    pool->position_x = (float *)at;
+    at += floats;
+    pool->position_y = (float *)at;
+    at += floats;
+    pool->velocity_x = (float *)at;
+    at += floats;
+    pool->velocity_y = (float *)at;
+    at += floats;
+    pool->emitter = (int *)at;
+    at += capacity * sizeof(int);
+    pool->fate = at;
+}
+
+// Sizes a world's entity arrays from bullet_max, live_invader_max and
+// emitter_max, and its pools from the given capacities.
+void alloc_world(World *w, int particle_capacity, int projectile_capacity)
+{
+    w->bullet_capacity = bullet_max;
+    w->invader_capacity = live_invader_max;
+    w->emitter_capacity = emitter_max < emitter_capacity_limit ? emitter_max : emitter_capacity_limit;
+
+    w->bullets = (Bullet *)calloc(w->bullet_capacity, sizeof(Bullet));
+    w->bullet_hits = (int *)calloc(w->bullet_capacity, sizeof(int));
+    w->live_invaders = (Invader *)calloc(w->invader_capacity, sizeof(Invader));
+    w->emitters = (Particle_Emitter *)calloc(w->emitter_capacity, sizeof(Particle_Emitter));
+    w->live_emitters = (int *)calloc(w->emitter_capacity, sizeof(int));
+    w->free_emitters = (int *)calloc(w->emitter_capacity, sizeof(int));
+
+    init_particle_pool(&w->particle_pool, particle_capacity);
+    init_projectile_pool(&w->projectiles, projectile_capacity);
+}
+
+void free_world(World *w)
+{
+    free(w->bullets);
+    free(w->bullet_hits);
+    free(w->live_invaders);
+    free(w->emitters);
+    free(w->live_emitters);
+    free(w->free_emitters);
+    free(w->particle_pool.memory);
+    free(w->projectiles.memory);
+    free(w->invader_grid.cell_start);
+    free(w->invader_grid.cell_fill);
+    free(w->invader_grid.items);
+    memset(w, 0, sizeof(*w));
+}
+
+void sim_particle(Particle_Pool *p, int i, float dt)
 {
-    assert(emitter->particle_count < particle_max);
-    Particle *p = &emitter->particles[emitter->particle_count++];
-    p->position = emitter->position;
-    p->velocity = emitter->velocity;
+    p->position_x[i] += p->velocity_x[i] * dt;
+    p->position_y[i] += p->velocity_y[i] * dt;
 
-    p->size = random_get_within_range(emitter->size0, emitter->size1);
-    p->drag = random_get_within_range(emitter->drag0, emitter->drag1);
-    p->lifetime = random_get_within_range(emitter->lifetime0, emitter->lifetime1);
-    p->elapsed = 0;
+    float drag = p->drag[i];
 
-    float color_t = random_get_within_range(0, 1);
-    p->color = lerp(emitter->color0, emitter->color1, color_t);
+    p->velocity_x[i] *= drag;
+    p->velocity_y[i] *= drag;
 
-    float speed = random_get_within_range(emitter->speed0, emitter->speed1);
-    float theta = random_get_within_range(emitter->theta0, emitter->theta1);
+    p->elapsed[i] += dt;
+}
+
+// Polynomial sin and cos, good to about 1e-6 over any angle a particle
+// emitter uses. The angle is wrapped into [-pi, pi] and folded into
+// [-pi/2, pi/2], where an odd degree 11 Taylor polynomial is accurate.
+const float PI = TAU * 0.5f;
+const float HALF_PI = TAU * 0.25f;
+
+inline float sin_poly(float x)
+{
+    float x2 = x * x;
+    return x * (1.0f + x2 * (-1.0f / 6.0f + x2 * (1.0f / 120.0f + x2 * (-1.0f / 5040.0f +
+                x2 * (1.0f / 362880.0f + x2 * (-1.0f / 39916800.0f))))));
+}
 
-    float ct = cosf(theta);
-    float st = sinf(theta);
+void fast_sincos(float theta, float *s, float *c)
+{
+    float x = theta - TAU * rintf(theta * (1.0f / TAU));
 
-    Vector2 v_rel;
-    v_rel.x = speed * ct;
-    v_rel.y = speed * st;
-    p->velocity.x += v_rel.x;
-    p->velocity.y += v_rel.y;
+    float sx = fminf(x, PI - x);
+    sx = fmaxf(sx, -PI - sx);
+    float cx = HALF_PI - x;
+    cx = fminf(cx, PI - cx);
 
-    return p;
+    *s = sin_poly(sx);
+    *c = sin_poly(cx);
 }
 
-void sim_particle(Particle *p, float dt)
+#if INVADERS_AVX || INVADERS_SSE2
+inline __m128 sin_poly_4(__m128 x)
 {
-    linear_move(&p->position, &p->velocity, dt);
+    __m128 x2 = _mm_mul_ps(x, x);
+    __m128 r = _mm_set1_ps(-1.0f / 39916800.0f);
+    r = _mm_add_ps(_mm_set1_ps(1.0f / 362880.0f), _mm_mul_ps(x2, r));
+    r = _mm_add_ps(_mm_set1_ps(-1.0f / 5040.0f), _mm_mul_ps(x2, r));
+    r = _mm_add_ps(_mm_set1_ps(1.0f / 120.0f), _mm_mul_ps(x2, r));
+    r = _mm_add_ps(_mm_set1_ps(-1.0f / 6.0f), _mm_mul_ps(x2, r));
+    r = _mm_add_ps(_mm_set1_ps(1.0f), _mm_mul_ps(x2, r));
+    return _mm_mul_ps(x, r);
+}
 
-    float drag = p->drag;
+void fast_sincos_4(__m128 theta, __m128 *s, __m128 *c)
+{
+    __m128 pi = _mm_set1_ps(PI);
+    __m128 turns = _mm_cvtepi32_ps(_mm_cvtps_epi32(_mm_mul_ps(theta, _mm_set1_ps(1.0f / TAU))));
+    __m128 x = _mm_sub_ps(theta, _mm_mul_ps(_mm_set1_ps(TAU), turns));
 
-    p->velocity.x *= drag;
-    p->velocity.y *= drag;
+    __m128 sx = _mm_min_ps(x, _mm_sub_ps(pi, x));
+    sx = _mm_max_ps(sx, _mm_sub_ps(_mm_sub_ps(_mm_setzero_ps(), pi), sx));
+    __m128 cx = _mm_sub_ps(_mm_set1_ps(HALF_PI), x);
+    cx = _mm_min_ps(cx, _mm_sub_ps(pi, cx));
 
-    p->elapsed += dt;
+    *s = sin_poly_4(sx);
+    *c = sin_poly_4(cx);
 }
+#endif
+
+// Most particles a spawn batch draws for at once; longer runs are split.
+const int spawn_chunk = 64;
+
+// Spawns count particles for emitter with one pass per attribute: random
+// ranges are filled a stream at a time, directions go through the
+// vectorized sincos and colors through a vectorized lerp. If age is given,
+// particle k is then integrated by age[k], the part of the tick it has
+// already lived. Returns the number spawned, fewer than count once the pool
+// is full.
+int spawn_particles(Particle_Emitter *emitter, int count, Rng_Stream *rng, const float *age)
+{
+    Particle_Pool *p = &world->particle_pool;
+    if (count > p->capacity - p->count)
+    {
+        count = p->capacity - p->count;
+    }
+    if (count <= 0)
+    {
+        return 0;
+    }
 
-void update_emitter(Particle_Emitter *emitter)
+    int first = p->count;
+    p->count += count;
+    emitter->particle_count += count;
+    int owner = (int)(emitter - world->emitters);
+
+    for (int done = 0; done < count; done += spawn_chunk)
+    {
+        int n = count - done < spawn_chunk ? count - done : spawn_chunk;
+        int at = first + done;
+
+        float color_t[spawn_chunk];
+        float speed[spawn_chunk];
+        float theta[spawn_chunk];
+        rng_fill_floats(rng, p->size + at, n, emitter->size0, emitter->size1);
+        rng_fill_floats(rng, p->drag + at, n, emitter->drag0, emitter->drag1);
+        rng_fill_floats(rng, p->lifetime + at, n, emitter->lifetime0, emitter->lifetime1);
+        rng_fill_floats(rng, color_t, n, 0, 1);
+        rng_fill_floats(rng, speed, n, emitter->speed0, emitter->speed1);
+        rng_fill_floats(rng, theta, n, emitter->theta0, emitter->theta1);
+
+        int k = 0;
+#if INVADERS_AVX || INVADERS_SSE2
+        __m128 vx0 = _mm_set1_ps(emitter->velocity.x);
+        __m128 vy0 = _mm_set1_ps(emitter->velocity.y);
+        for (; k + 4 <= n; k += 4)
+        {
+            __m128 st, ct;
+            fast_sincos_4(_mm_loadu_ps(theta + k), &st, &ct);
+            __m128 v = _mm_loadu_ps(speed + k);
+            _mm_storeu_ps(p->velocity_x + at + k, _mm_add_ps(vx0, _mm_mul_ps(v, ct)));
+            _mm_storeu_ps(p->velocity_y + at + k, _mm_add_ps(vy0, _mm_mul_ps(v, st)));
+        }
+#endif
+        for (; k < n; k++)
+        {
+            float st, ct;
+            fast_sincos(theta[k], &st, &ct);
+            p->velocity_x[at + k] = emitter->velocity.x + speed[k] * ct;
+            p->velocity_y[at + k] = emitter->velocity.y + speed[k] * st;
+        }
+
+#if INVADERS_AVX || INVADERS_SSE2
+        __m128 c0 = _mm_loadu_ps(&emitter->color0.x);
+        __m128 dc = _mm_sub_ps(_mm_loadu_ps(&emitter->color1.x), c0);
+        for (k = 0; k < n; k++)
+        {
+            _mm_storeu_ps(&p->color[at + k].x, _mm_add_ps(c0, _mm_mul_ps(_mm_set1_ps(color_t[k]), dc)));
+        }
+#else
+        for (k = 0; k < n; k++)
+        {
+            p->color[at + k] = lerp(emitter->color0, emitter->color1, color_t[k]);
+        }
+#endif
+
+        for (k = 0; k < n; k++)
+        {
+            p->position_x[at + k] = emitter->position.x;
+            p->position_y[at + k] = emitter->position.y;
+            p->elapsed[at + k] = 0;
+            p->emitter[at + k] = owner;
+        }
+    }
+
+    if (age)
+    {
+        for (int k = 0; k < count; k++)
+        {
+            sim_particle(p, first + k, age[k]);
+        }
+    }
+    return count;
+}
+
+// Spawns count particles at once, on top of whatever the emitter produces
+// over time.
+int emit_burst(Particle_Emitter *emitter, int count)
 {
-    if (!emitter->alive)
+    Rng_Stream rng = entity_stream(emitter->id, RNG_BURST);
+    return spawn_particles(emitter, count, &rng, NULL);
+}
+
+// Integrates particles [first, first + count) by dt, a vector register at a
+// time where the target supports it, then finishes the tail with sim_particle.
+void sim_particles(Particle_Pool *p, int first, int count, float dt)
+{
+    int i = first;
+    int end = first + count;
+
+#if INVADERS_AVX
+    __m256 vdt = _mm256_set1_ps(dt);
+    for (; i + 8 <= end; i += 8)
     {
-        return;
+        __m256 px = _mm256_loadu_ps(p->position_x + i);
+        __m256 py = _mm256_loadu_ps(p->position_y + i);
+        __m256 vx = _mm256_loadu_ps(p->velocity_x + i);
+        __m256 vy = _mm256_loadu_ps(p->velocity_y + i);
+        __m256 drag = _mm256_loadu_ps(p->drag + i);
+        __m256 elapsed = _mm256_loadu_ps(p->elapsed + i);
+
+        px = _mm256_add_ps(px, _mm256_mul_ps(vx, vdt));
+        py = _mm256_add_ps(py, _mm256_mul_ps(vy, vdt));
+        vx = _mm256_mul_ps(vx, drag);
+        vy = _mm256_mul_ps(vy, drag);
+        elapsed = _mm256_add_ps(elapsed, vdt);
+
+        _mm256_storeu_ps(p->position_x + i, px);
+        _mm256_storeu_ps(p->position_y + i, py);
+        _mm256_storeu_ps(p->velocity_x + i, vx);
+        _mm256_storeu_ps(p->velocity_y + i, vy);
+        _mm256_storeu_ps(p->elapsed + i, elapsed);
     }
-    float dt = current_dt;
-    int i = 0;
-    while (i < emitter->particle_count)
+#endif
+
+#if INVADERS_AVX || INVADERS_SSE2
+    __m128 vdt4 = _mm_set1_ps(dt);
+    for (; i + 4 <= end; i += 4)
     {
-        Particle *p = &emitter->particles[i];
-        sim_particle(p, dt);
+        __m128 px = _mm_loadu_ps(p->position_x + i);
+        __m128 py = _mm_loadu_ps(p->position_y + i);
+        __m128 vx = _mm_loadu_ps(p->velocity_x + i);
+        __m128 vy = _mm_loadu_ps(p->velocity_y + i);
+        __m128 drag = _mm_loadu_ps(p->drag + i);
+        __m128 elapsed = _mm_loadu_ps(p->elapsed + i);
+
+        px = _mm_add_ps(px, _mm_mul_ps(vx, vdt4));
+        py = _mm_add_ps(py, _mm_mul_ps(vy, vdt4));
+        vx = _mm_mul_ps(vx, drag);
+        vy = _mm_mul_ps(vy, drag);
+        elapsed = _mm_add_ps(elapsed, vdt4);
+
+        _mm_storeu_ps(p->position_x + i, px);
+        _mm_storeu_ps(p->position_y + i, py);
+        _mm_storeu_ps(p->velocity_x + i, vx);
+        _mm_storeu_ps(p->velocity_y + i, vy);
+        _mm_storeu_ps(p->elapsed + i, elapsed);
+    }
+#endif
+
+    for (; i < end; i++)
+    {
+        sim_particle(p, i, dt);
+    }
+}
+
+void copy_particle(Particle_Pool *p, int dest, int src)
+{
+    p->position_x[dest] = p->position_x[src];
+    p->position_y[dest] = p->position_y[src];
+    p->velocity_x[dest] = p->velocity_x[src];
+    p->velocity_y[dest] = p->velocity_y[src];
+    p->drag[dest] = p->drag[src];
+    p->elapsed[dest] = p->elapsed[src];
+    p->lifetime[dest] = p->lifetime[src];
+    p->size[dest] = p->size[src];
+    p->color[dest] = p->color[src];
+    p->emitter[dest] = p->emitter[src];
+}
+
+void integrate_particles(int first, int end)
+{
+    sim_particles(&world->particle_pool, first, end - first, world->current_dt);
+}
+
+// Integrates every particle in the pool, in parallel chunks, then removes
+// the expired ones, crediting them back to their emitters.
+void simulate_particles()
+{
+    PROFILE_ZONE("simulate_particles");
+
+    Particle_Pool *p = &world->particle_pool;
+    parallel_for_world(p->count, particle_grain, integrate_particles);
 
-        if (p->elapsed > p->lifetime)
+    int i = 0;
+    while (i < p->count)
+    {
+        if (p->elapsed[i] > p->lifetime[i])
         {
-            emitter->particles[i] = emitter->particles[--emitter->particle_count];
+            world->emitters[p->emitter[i]].particle_count--;
+            copy_particle(p, i, --p->count);
         }
         else
         {
             i++;
         }
     }
+}
+
+void update_emitter(Particle_Emitter *emitter)
+{
+    if (!emitter->alive)
+    {
+        return;
+    }
+    float dt = world->current_dt;
 
     float dt_per_particle = 1.0f / emitter->particles_per_second;
 
@@ -307,52 +793,73 @@ void update_emitter(Particle_Emitter *emitter)
 
     if (emitter->producing)
     {
+        // Every particle due this tick goes in one batch, each aged by the
+        // time left in the tick after it was due.
+        Rng_Stream rng = entity_stream(emitter->id, RNG_PARTICLES);
+        float age[spawn_chunk];
+        int due = 0;
         while (emitter->remainder > dt_per_particle)
         {
             emitter->remainder -= dt_per_particle;
-            Particle *p = spawn_particle(emitter);
-            sim_particle(p, emitter->remainder);
+            age[due++] = emitter->remainder;
+            if (due == spawn_chunk)
+            {
+                spawn_particles(emitter, due, &rng, age);
+                due = 0;
+            }
         }
+        spawn_particles(emitter, due, &rng, age);
     }
     else
     {
         if (emitter->particle_count == 0)
         {
             emitter->alive = false;
-            live_emitter_count--;
         }
     }
 }
 
-void init_target(Invader *invader)
+void init_target(Invader *invader, Rng_Stream *rng)
 {
     float b = 0.05f;
-    invader->target_position.x = random_get_within_range(b, 1.0f - b);
-    invader->target_position.y = random_get_within_range(0.2f, 0.7f);
+    invader->target_position.x = rng_float(rng, b, 1.0f - b);
+    invader->target_position.y = rng_float(rng, 0.2f, 0.7f);
 }
 
-void init_invader(Invader *invader)
+void init_invader(Invader *invader, Rng_Stream *rng)
 {
-    init_target(invader);
+    init_target(invader, rng);
 
     const float INITIAL_Y = 0.8f;
     const float invader_speed = 0.01f;
     invader->position.x = invader->target_position.x;
     invader->position.y = INITIAL_Y;
+    invader->previous_position = invader->position;
     invader->velocity.x = 0;
     invader->velocity.y = 0;
 }
 
+// Seconds between an invader's shots.
+const float invader_fire_period0 = 1.5f;
+const float invader_fire_period1 = 4.0f;
+
 void add_invader()
 {
-    assert(live_invader_count < live_invader_max);
-    Invader *invader = &live_invaders[live_invader_count++];
+    if (world->live_invader_count >= world->invader_capacity)
+        return;
 
-    int which = random_get() % invader_bitmap_count;
+    Invader *invader = &world->live_invaders[world->live_invader_count++];
+
+    invader->id = world->next_entity_id++;
+    Rng_Stream rng = entity_stream(invader->id, RNG_SPAWN);
+
+    int which = rng_next(&rng) % invader_bitmap_count;
     invader->bitmap = &invader_bitmaps[which];
     invader->sleep_countdown = -1.0f;
+    invader->destroyed = false;
 
-    init_invader(invader);
+    init_invader(invader, &rng);
+    invader->fire_countdown = rng_float(&rng, invader_fire_period0, invader_fire_period1);
 }
 
 float ilength(float x, float y)
@@ -368,19 +875,42 @@ float distance(Vector2 a, Vector2 b)
     return sqrtf(dx * dx + dy * dy);
 }
 
-Particle_Emitter *spawn_emitter()
+void init_emitters()
 {
-    Particle_Emitter *emitter = NULL;
-    for (int i = 0; i < emitter_max; i++)
+    world->live_emitter_count = 0;
+    world->free_emitter_count = 0;
+
+    // Push in reverse so the lowest slots are handed out first.
+    for (int i = world->emitter_capacity - 1; i >= 0; i--)
     {
-        if (emitters[i].alive == false)
-        {
-            emitter = &emitters[i];
-            break;
-        }
+        world->emitters[i].alive = false;
+        world->free_emitters[world->free_emitter_count++] = i;
     }
-    if (emitter)
+}
+
+void release_emitter(Particle_Emitter *emitter)
+{
+    int index = (int)(emitter - world->emitters);
+    int live_index = emitter->live_index;
+
+    int moved = world->live_emitters[--world->live_emitter_count];
+    world->live_emitters[live_index] = moved;
+    world->emitters[moved].live_index = live_index;
+
+    world->free_emitters[world->free_emitter_count++] = index;
+}
+
+Particle_Emitter *spawn_emitter()
+{
+    Particle_Emitter *emitter = NULL;
+    if (world->free_emitter_count > 0)
     {
+        int index = world->free_emitters[--world->free_emitter_count];
+        emitter = &world->emitters[index];
+        emitter->live_index = world->live_emitter_count;
+        world->live_emitters[world->live_emitter_count++] = index;
+
+        emitter->id = world->next_entity_id++;
         emitter->particle_count = 0;
         emitter->fadeout_period = 0.1f;
         emitter->particles_per_second = 150.0f;
@@ -397,19 +927,24 @@ Particle_Emitter *spawn_emitter()
         emitter->theta1 = TAU;
         emitter->elapsed = 0;
         emitter->remainder = 0;
+        emitter->projectile = -1;
         emitter->producing = true;
         emitter->alive = true;
-        live_emitter_count++;
     }
     return emitter;
 }
 
 void destroy_invader(Invader *invader)
 {
-    Particle_Emitter *emitter = spawn_emitter();
+    world->num_invaders_destroyed++;
+    invader->destroyed = true;
 
-    if (emitter)
+    for (int i = 0; i < emitters_per_explosion; i++)
     {
+        Particle_Emitter *emitter = spawn_emitter();
+        if (!emitter)
+            break;
+
         emitter->velocity.x = 0;
 
         emitter->velocity.y = 0;
@@ -424,59 +959,142 @@ void destroy_invader(Invader *invader)
         emitter->emitter_lifetime = 0.3f;
 
         emitter->position = invader->position;
+        emit_burst(emitter, explosion_burst);
     }
 }
 
-bool test_against_invaders(Bullet *bullet)
+
+int grid_coordinate(Invader_Grid *grid, float v)
+{
+    int c = (int)(v * grid->cells_per_side);
+    if (c < 0)
+        c = 0;
+    if (c >= grid->cells_per_side)
+        c = grid->cells_per_side - 1;
+    return c;
+}
+
+int grid_cell(Invader_Grid *grid, Vector2 p)
+{
+    return grid_coordinate(grid, p.y) * grid->cells_per_side + grid_coordinate(grid, p.x);
+}
+
+void build_invader_grid(Invader_Grid *grid, Invader *invaders, int count)
 {
-    for (int i = 0; i < live_invader_count; i++)
+    // Cells are at least an invader wide, and shrink as the playfield gets
+    // crowded so that each one holds a handful of invaders.
+    int side = (int)(1.0f / (2.0f * INVADER_RADIUS));
+    int crowded = (int)sqrtf(count * 0.25f);
+    if (crowded > side)
+        side = crowded;
+    if (side > 1024)
+        side = 1024;
+    grid->cells_per_side = side;
+
+    int cells = side * side;
+    if (cells > grid->cell_capacity)
     {
-        if (distance(bullet->position, live_invaders[i].position) < INVADER_RADIUS)
-        {
-            destroy_invader(&live_invaders[i]);
-            live_invaders[i] = live_invaders[--live_invader_count];
-            return true;
-        }
+        grid->cell_capacity = cells;
+        grid->cell_start = (int *)realloc(grid->cell_start, (cells + 1) * sizeof(int));
+        grid->cell_fill = (int *)realloc(grid->cell_fill, cells * sizeof(int));
+    }
+    if (count > grid->item_capacity)
+    {
+        grid->item_capacity = count;
+        grid->items = (int *)realloc(grid->items, count * sizeof(int));
+    }
+
+    memset(grid->cell_start, 0, (cells + 1) * sizeof(int));
+    for (int i = 0; i < count; i++)
+    {
+        grid->cell_start[grid_cell(grid, invaders[i].position) + 1]++;
+    }
+    for (int c = 0; c < cells; c++)
+    {
+        grid->cell_start[c + 1] += grid->cell_start[c];
+        grid->cell_fill[c] = grid->cell_start[c];
+    }
+    for (int i = 0; i < count; i++)
+    {
+        int c = grid_cell(grid, invaders[i].position);
+        grid->items[grid->cell_fill[c]++] = i;
     }
-    return false;
 }
 
-bool simulate_bullet(Bullet *bullet)
+// Returns the lowest-indexed live invader within radius of position, or -1.
+int find_invader_in_grid(Invader_Grid *grid, Invader *invaders, Vector2 position, float radius)
 {
-    linear_move(&bullet->position, &bullet->velocity, current_dt);
+    int x0 = grid_coordinate(grid, position.x - radius);
+    int x1 = grid_coordinate(grid, position.x + radius);
+    int y0 = grid_coordinate(grid, position.y - radius);
+    int y1 = grid_coordinate(grid, position.y + radius);
 
-    if (bullet->emitter)
+    float radius_sq = radius * radius;
+    int best = -1;
+
+    for (int y = y0; y <= y1; y++)
     {
-        bullet->emitter->position = bullet->position;
-        bullet->emitter->velocity = bullet->velocity;
+        for (int x = x0; x <= x1; x++)
+        {
+            int c = y * grid->cells_per_side + x;
+            for (int k = grid->cell_start[c]; k < grid->cell_start[c + 1]; k++)
+            {
+                int i = grid->items[k];
+                if (best >= 0 && i >= best)
+                    break;
+
+                Invader *invader = &invaders[i];
+                if (invader->destroyed)
+                    continue;
+
+                float dx = invader->position.x - position.x;
+                float dy = invader->position.y - position.y;
+                if (dx * dx + dy * dy < radius_sq)
+                {
+                    best = i;
+                    break;
+                }
+            }
+        }
     }
 
-    if (bullet->position.y > live_y_max)
-        return true;
-    if (bullet->position.y < live_y_min)
-        return true;
+    return best;
+}
 
-    if (test_against_invaders(bullet))
-        return true;
+// Reference O(invaders) search the grid is measured against.
+int find_invader_brute_force(Invader *invaders, int count, Vector2 position, float radius)
+{
+    for (int i = 0; i < count; i++)
+    {
+        if (!invaders[i].destroyed && distance(position, invaders[i].position) < radius)
+        {
+            return i;
+        }
+    }
+    return -1;
+}
 
+bool test_against_invaders(Bullet *bullet)
+{
+    int i = find_invader_in_grid(&world->invader_grid, world->live_invaders, bullet->position, INVADER_RADIUS);
+    if (i >= 0)
+    {
+        destroy_invader(&world->live_invaders[i]);
+        return true;
+    }
     return false;
 }
 
-void simulate_bullets()
+// Invaders hit during simulate_bullets stay in place until every bullet has
+// been tested, so the indices in invader_grid remain valid.
+void remove_destroyed_invaders()
 {
     int i = 0;
-    while (i < bullet_count)
+    while (i < world->live_invader_count)
     {
-        Bullet *bullet = &bullets[i];
-        bool done = simulate_bullet(bullet);
-
-        if (done)
+        if (world->live_invaders[i].destroyed)
         {
-            if (bullet->emitter)
-            {
-                bullet->emitter->producing = false;
-            }
-            bullets[i] = bullets[--bullet_count];
+            world->live_invaders[i] = world->live_invaders[--world->live_invader_count];
         }
         else
         {
@@ -485,62 +1103,435 @@ void simulate_bullets()
     }
 }
 
-void simulate_invader(Invader *invader)
+// Marks a bullet that has left the playfield in bullet_hits.
+const int bullet_gone = -2;
+
+// Moves bullets [first, end) and finds the invader each one hits. Nothing
+// shared is written, so chunks can run in parallel.
+void move_bullets(int first, int end)
 {
-    if (invader->sleep_countdown < 0)
+    for (int i = first; i < end; i++)
     {
-        float speed = 0.3f;
-        float delta = speed * current_dt;
-
-        float dx = invader->target_position.x - invader->position.x;
-        float dy = invader->target_position.y - invader->position.y;
-
-        float denom = ilength(dx, dy);
-        dx *= denom;
-        dy *= denom;
+        Bullet *bullet = &world->bullets[i];
+        linear_move(&bullet->position, &bullet->velocity, world->current_dt);
 
-        invader->position.x += dx * delta;
-        invader->position.y += dy * delta;
+        if (bullet->emitter)
+        {
+            bullet->emitter->position = bullet->position;
+            bullet->emitter->velocity = bullet->velocity;
+        }
 
-        if (distance(invader->target_position, invader->position) < 0.005f)
+        if (bullet->position.y > live_y_max || bullet->position.y < live_y_min)
         {
-            invader->sleep_countdown = random_get_within_range(0.1f, 1.5f);
+            world->bullet_hits[i] = bullet_gone;
         }
-    }
-    else
-    {
-        invader->sleep_countdown -= current_dt;
-        if (invader->sleep_countdown < 0)
+        else
         {
-            init_target(invader);
+            world->bullet_hits[i] = find_invader_in_grid(&world->invader_grid, world->live_invaders, bullet->position, INVADER_RADIUS);
         }
     }
 }
 
-void simulate_invaders()
+void simulate_bullets()
 {
-    for (int i = 0; i < live_invader_count; i++)
-    {
-        simulate_invader(&live_invaders[i]);
-    }
-}
+    PROFILE_ZONE("simulate_bullets");
 
-void simulate_emitters()
-{
-    for (int i = 0; i < emitter_max; i++)
-    {
-        update_emitter(&emitters[i]);
-    }
-}
+    if (world->bullet_count == 0)
+        return;
 
-Bullet *fire_bullet()
-{
-    if (bullet_count >= bullet_max)
-        return NULL;
+    build_invader_grid(&world->invader_grid, world->live_invaders, world->live_invader_count);
+    parallel_for_world(world->bullet_count, bullet_grain, move_bullets);
 
-    Bullet *bullet = &bullets[bullet_count++];
+    // Commit hits in the order a serial pass would make them. If an earlier
+    // bullet destroyed the invader a bullet found, it searches again.
+    int i = 0;
+    while (i < world->bullet_count)
+    {
+        Bullet *bullet = &world->bullets[i];
+        int hit = world->bullet_hits[i];
 
-    bullet->position = ship_position;
+        bool done = false;
+        if (hit == bullet_gone)
+        {
+            done = true;
+        }
+        else if (hit >= 0 && !world->live_invaders[hit].destroyed)
+        {
+            destroy_invader(&world->live_invaders[hit]);
+            done = true;
+        }
+        else if (hit >= 0)
+        {
+            done = test_against_invaders(bullet);
+        }
+
+        if (done)
+        {
+            if (bullet->emitter)
+            {
+                bullet->emitter->producing = false;
+            }
+            world->bullet_count--;
+            world->bullets[i] = world->bullets[world->bullet_count];
+            world->bullet_hits[i] = world->bullet_hits[world->bullet_count];
+        }
+        else
+        {
+            i++;
+        }
+    }
+
+    remove_destroyed_invaders();
+}
+
+// Playfield bounds past which a projectile is dropped.
+const float projectile_x_min = -0.05f;
+const float projectile_x_max = 1.05f;
+
+// Moves projectiles [first, first + count) by dt and sorts each into a
+// Projectile_Fate: the broad-phase against the ship is a box test done a
+// register at a time alongside the move.
+void sim_projectiles(Projectile_Pool *p, int first, int count, float dt, Vector2 ship)
+{
+    int i = first;
+    int end = first + count;
+    float reach = SHIP_RADIUS + PROJECTILE_RADIUS;
+
+#if INVADERS_AVX
+    __m256 vdt8 = _mm256_set1_ps(dt);
+    __m256 ship_x8 = _mm256_set1_ps(ship.x);
+    __m256 ship_y8 = _mm256_set1_ps(ship.y);
+    __m256 reach8 = _mm256_set1_ps(reach);
+    __m256 x_min8 = _mm256_set1_ps(projectile_x_min);
+    __m256 x_max8 = _mm256_set1_ps(projectile_x_max);
+    __m256 y_min8 = _mm256_set1_ps(live_y_min);
+    __m256 y_max8 = _mm256_set1_ps(live_y_max);
+    __m256 sign8 = _mm256_set1_ps(-0.0f);
+    for (; i + 8 <= end; i += 8)
+    {
+        __m256 px = _mm256_add_ps(_mm256_loadu_ps(p->position_x + i), _mm256_mul_ps(_mm256_loadu_ps(p->velocity_x + i), vdt8));
+        __m256 py = _mm256_add_ps(_mm256_loadu_ps(p->position_y + i), _mm256_mul_ps(_mm256_loadu_ps(p->velocity_y + i), vdt8));
+        _mm256_storeu_ps(p->position_x + i, px);
+        _mm256_storeu_ps(p->position_y + i, py);
+
+        __m256 dx = _mm256_andnot_ps(sign8, _mm256_sub_ps(px, ship_x8));
+        __m256 dy = _mm256_andnot_ps(sign8, _mm256_sub_ps(py, ship_y8));
+        int near = _mm256_movemask_ps(_mm256_and_ps(_mm256_cmp_ps(dx, reach8, _CMP_LE_OQ), _mm256_cmp_ps(dy, reach8, _CMP_LE_OQ)));
+        __m256 inside = _mm256_and_ps(_mm256_and_ps(_mm256_cmp_ps(px, x_min8, _CMP_GE_OQ), _mm256_cmp_ps(px, x_max8, _CMP_LE_OQ)),
+                                      _mm256_and_ps(_mm256_cmp_ps(py, y_min8, _CMP_GE_OQ), _mm256_cmp_ps(py, y_max8, _CMP_LE_OQ)));
+        int gone = _mm256_movemask_ps(inside) ^ 0xff;
+
+        uint64_t fates = 0;
+        if (near | gone)
+        {
+            for (int lane = 0; lane < 8; lane++)
+            {
+                uint64_t fate = (near >> lane) & 1 ? PROJECTILE_NEAR_SHIP : (gone >> lane) & 1 ? PROJECTILE_GONE : PROJECTILE_LIVE;
+                fates |= fate << (lane * 8);
+            }
+        }
+        memcpy(p->fate + i, &fates, sizeof(fates));
+    }
+#endif
+
+#if INVADERS_AVX || INVADERS_SSE2
+    __m128 vdt = _mm_set1_ps(dt);
+    __m128 ship_x = _mm_set1_ps(ship.x);
+    __m128 ship_y = _mm_set1_ps(ship.y);
+    __m128 vreach = _mm_set1_ps(reach);
+    __m128 x_min = _mm_set1_ps(projectile_x_min);
+    __m128 x_max = _mm_set1_ps(projectile_x_max);
+    __m128 y_min = _mm_set1_ps(live_y_min);
+    __m128 y_max = _mm_set1_ps(live_y_max);
+    __m128 sign = _mm_set1_ps(-0.0f);
+    for (; i + 4 <= end; i += 4)
+    {
+        __m128 px = _mm_add_ps(_mm_loadu_ps(p->position_x + i), _mm_mul_ps(_mm_loadu_ps(p->velocity_x + i), vdt));
+        __m128 py = _mm_add_ps(_mm_loadu_ps(p->position_y + i), _mm_mul_ps(_mm_loadu_ps(p->velocity_y + i), vdt));
+        _mm_storeu_ps(p->position_x + i, px);
+        _mm_storeu_ps(p->position_y + i, py);
+
+        __m128 dx = _mm_andnot_ps(sign, _mm_sub_ps(px, ship_x));
+        __m128 dy = _mm_andnot_ps(sign, _mm_sub_ps(py, ship_y));
+        int near = _mm_movemask_ps(_mm_and_ps(_mm_cmple_ps(dx, vreach), _mm_cmple_ps(dy, vreach)));
+        __m128 inside = _mm_and_ps(_mm_and_ps(_mm_cmpge_ps(px, x_min), _mm_cmple_ps(px, x_max)),
+                                   _mm_and_ps(_mm_cmpge_ps(py, y_min), _mm_cmple_ps(py, y_max)));
+        int gone = _mm_movemask_ps(inside) ^ 0xf;
+
+        uint32_t fates = 0;
+        if (near | gone)
+        {
+            for (int lane = 0; lane < 4; lane++)
+            {
+                uint32_t fate = (near >> lane) & 1 ? PROJECTILE_NEAR_SHIP : (gone >> lane) & 1 ? PROJECTILE_GONE : PROJECTILE_LIVE;
+                fates |= fate << (lane * 8);
+            }
+        }
+        memcpy(p->fate + i, &fates, sizeof(fates));
+    }
+#endif
+
+    for (; i < end; i++)
+    {
+        float px = p->position_x[i] + p->velocity_x[i] * dt;
+        float py = p->position_y[i] + p->velocity_y[i] * dt;
+        p->position_x[i] = px;
+        p->position_y[i] = py;
+
+        if (fabsf(px - ship.x) <= reach && fabsf(py - ship.y) <= reach)
+            p->fate[i] = PROJECTILE_NEAR_SHIP;
+        else if (px >= projectile_x_min && px <= projectile_x_max && py >= live_y_min && py <= live_y_max)
+            p->fate[i] = PROJECTILE_LIVE;
+        else
+            p->fate[i] = PROJECTILE_GONE;
+    }
+}
+
+// Adds a projectile, trailed by a contrail emitter if contrail is set and
+// one is free. Returns false when the pool is full.
+bool fire_projectile(Vector2 position, Vector2 velocity, bool contrail)
+{
+    Projectile_Pool *p = &world->projectiles;
+    if (p->count >= p->capacity)
+        return false;
+
+    int i = p->count++;
+    p->position_x[i] = position.x;
+    p->position_y[i] = position.y;
+    p->velocity_x[i] = velocity.x;
+    p->velocity_y[i] = velocity.y;
+    p->emitter[i] = -1;
+
+    Particle_Emitter *emitter = contrail ? spawn_emitter() : NULL;
+    if (emitter)
+    {
+        emitter->position = position;
+        emitter->velocity = velocity;
+        emitter->particles_per_second = 60.0f;
+        emitter->theta0 = TAU * 0.1f;
+        emitter->theta1 = TAU * 0.4f;
+        emitter->drag0 = 0.9f;
+        emitter->drag1 = 0.97f;
+        emitter->lifetime1 = 0.6f;
+        emitter->color0 = make_vector4(1, 0.5f, 0.2f, 1);
+        emitter->color1 = make_vector4(0.4f, 0.05f, 0.05f, 1);
+        emitter->projectile = i;
+        p->emitter[i] = (int)(emitter - world->emitters);
+    }
+    return true;
+}
+
+// Removes projectile i, moving the last one into its place.
+void remove_projectile(int i)
+{
+    Projectile_Pool *p = &world->projectiles;
+    if (p->emitter[i] >= 0)
+    {
+        Particle_Emitter *emitter = &world->emitters[p->emitter[i]];
+        emitter->producing = false;
+        emitter->projectile = -1;
+    }
+
+    int last = --p->count;
+    p->position_x[i] = p->position_x[last];
+    p->position_y[i] = p->position_y[last];
+    p->velocity_x[i] = p->velocity_x[last];
+    p->velocity_y[i] = p->velocity_y[last];
+    p->emitter[i] = p->emitter[last];
+    p->fate[i] = p->fate[last];
+    if (p->emitter[i] >= 0)
+    {
+        world->emitters[p->emitter[i]].projectile = i;
+    }
+}
+
+void hit_ship()
+{
+    world->num_ship_hits++;
+
+    Particle_Emitter *emitter = spawn_emitter();
+    if (emitter)
+    {
+        emitter->position = world->ship_position;
+        emitter->velocity = make_vector2(0, 0);
+        emitter->speed1 = 0.2f;
+        emitter->size0 = 0.005f;
+        emitter->size1 = 0.015f;
+        emitter->lifetime1 = 0.5f;
+        emitter->color0 = make_vector4(1, 1, 0.6f, 1);
+        emitter->color1 = make_vector4(1, 0.2f, 0.1f, 1);
+        emitter->producing = false;
+        emit_burst(emitter, ship_hit_burst);
+    }
+}
+
+void move_projectiles(int first, int end)
+{
+    sim_projectiles(&world->projectiles, first, end - first, world->current_dt, world->ship_position);
+}
+
+// Moves every projectile in parallel chunks, then settles the fates
+// serially from the top index down, so each removal only ever moves a
+// projectile that has already been settled. Runs of live projectiles are
+// skipped sixteen fates at a time.
+void simulate_projectiles()
+{
+    PROFILE_ZONE("simulate_projectiles");
+
+    Projectile_Pool *p = &world->projectiles;
+    parallel_for_world(p->count, projectile_grain, move_projectiles);
+
+    float reach = SHIP_RADIUS + PROJECTILE_RADIUS;
+    int i = p->count;
+    while (i > 0)
+    {
+#if INVADERS_AVX || INVADERS_SSE2
+        if (i >= 16)
+        {
+            __m128i fates = _mm_loadu_si128((const __m128i *)(p->fate + i - 16));
+            if (_mm_movemask_epi8(_mm_cmpeq_epi8(fates, _mm_setzero_si128())) == 0xffff)
+            {
+                i -= 16;
+                continue;
+            }
+        }
+#endif
+        i--;
+        if (p->fate[i] == PROJECTILE_LIVE)
+            continue;
+
+        if (p->fate[i] == PROJECTILE_NEAR_SHIP)
+        {
+            Vector2 position = make_vector2(p->position_x[i], p->position_y[i]);
+            if (distance(position, world->ship_position) >= reach)
+                continue;
+            hit_ship();
+        }
+        remove_projectile(i);
+    }
+
+    // Contrails follow their projectiles.
+    for (int e = 0; e < world->live_emitter_count; e++)
+    {
+        Particle_Emitter *emitter = &world->emitters[world->live_emitters[e]];
+        if (emitter->projectile >= 0)
+        {
+            int k = emitter->projectile;
+            emitter->position = make_vector2(p->position_x[k], p->position_y[k]);
+            emitter->velocity = make_vector2(p->velocity_x[k], p->velocity_y[k]);
+        }
+    }
+}
+
+void simulate_invader(Invader *invader)
+{
+    invader->fire_countdown -= world->current_dt;
+
+    if (invader->sleep_countdown < 0)
+    {
+        float speed = 0.3f;
+        float delta = speed * world->current_dt;
+
+        float dx = invader->target_position.x - invader->position.x;
+        float dy = invader->target_position.y - invader->position.y;
+
+        float denom = ilength(dx, dy);
+        dx *= denom;
+        dy *= denom;
+
+        invader->position.x += dx * delta;
+        invader->position.y += dy * delta;
+
+        if (distance(invader->target_position, invader->position) < 0.005f)
+        {
+            Rng_Stream rng = entity_stream(invader->id, RNG_BEHAVIOUR);
+            invader->sleep_countdown = rng_float(&rng, 0.1f, 1.5f);
+        }
+    }
+    else
+    {
+        invader->sleep_countdown -= world->current_dt;
+        if (invader->sleep_countdown < 0)
+        {
+            Rng_Stream rng = entity_stream(invader->id, RNG_BEHAVIOUR);
+            init_target(invader, &rng);
+        }
+    }
+}
+
+void move_invaders(int first, int end)
+{
+    for (int i = first; i < end; i++)
+    {
+        simulate_invader(&world->live_invaders[i]);
+    }
+}
+
+// Fires at the ship, a little off aim.
+void fire_from_invader(Invader *invader)
+{
+    Rng_Stream rng = entity_stream(invader->id, RNG_FIRE);
+    invader->fire_countdown = rng_float(&rng, invader_fire_period0, invader_fire_period1);
+
+    const float projectile_speed = 0.3f;
+    float dx = world->ship_position.x - invader->position.x;
+    float dy = world->ship_position.y - invader->position.y;
+    float theta = atan2f(dy, dx) + rng_float(&rng, -0.15f, 0.15f);
+
+    float s, c;
+    fast_sincos(theta, &s, &c);
+    fire_projectile(invader->position, make_vector2(c * projectile_speed, s * projectile_speed), true);
+}
+
+// Invaders move in parallel, drawing from their own streams. Firing adds
+// to shared pools, so it is a serial pass afterwards.
+void simulate_invaders()
+{
+    PROFILE_ZONE("simulate_invaders");
+
+    parallel_for_world(world->live_invader_count, invader_grain, move_invaders);
+
+    for (int i = 0; i < world->live_invader_count; i++)
+    {
+        Invader *invader = &world->live_invaders[i];
+        if (invader->fire_countdown < 0)
+        {
+            fire_from_invader(invader);
+        }
+    }
+}
+
+void simulate_emitters()
+{
+    PROFILE_ZONE("simulate_emitters");
+
+    simulate_particles();
+
+    int i = 0;
+    while (i < world->live_emitter_count)
+    {
+        Particle_Emitter *emitter = &world->emitters[world->live_emitters[i]];
+        update_emitter(emitter);
+
+        if (!emitter->alive)
+        {
+            release_emitter(emitter);
+        }
+        else
+        {
+            i++;
+        }
+    }
+}
+
+Bullet *fire_bullet()
+{
+    if (world->bullet_count >= world->bullet_capacity)
+        return NULL;
+
+    Bullet *bullet = &world->bullets[world->bullet_count++];
+
+    bullet->position = world->ship_position;
 
     bullet->velocity.x = 0;
     bullet->velocity.y = 0.4f;
@@ -554,179 +1545,1536 @@ Bullet *fire_bullet()
         bullet->emitter->drag0 = 0.9f;
         bullet->emitter->drag1 = 0.97f;
 
-        float k0 = 1.0f;
-        float k1 = 0.1f;
+        float k0 = 1.0f;
+        float k1 = 0.1f;
+
+        bullet->emitter->color0 = make_vector4(k0, k0, k0, 1);
+        bullet->emitter->color1 = make_vector4(k1, k1, k1, 1);
+    }
+
+    return bullet;
+}
+
+void do_fire_bullets()
+{
+    Bullet *left = fire_bullet();
+    Bullet *right = fire_bullet();
+
+    float offset = 0.023f;
+    if (left)
+    {
+        left->position.x -= offset;
+        left->previous_position = left->position;
+    }
+    if (right)
+    {
+        right->position.x += offset;
+        right->previous_position = right->position;
+    }
+
+    world->num_shots_fired += 1;
+}
+
+// Input recording and replay. A log is a header holding everything that
+// seeds the simulation, followed by one record per frame: the frame's time
+// delta and the events applied during it, each with the tick of the frame it
+// was applied before. Playing a log back on the same build reproduces the
+// recorded session bit for bit.
+
+const uint32_t input_log_magic = 0x52564e49; // "INVR"
+const uint32_t input_log_version = 4;
+
+FILE *record_file = NULL;
+FILE *playback_file = NULL;
+
+const int frame_event_max = 256;
+int frame_event_count = 0;
+int frame_event_next = 0;
+Event frame_events[frame_event_max];
+uint8_t frame_event_ticks[frame_event_max];
+
+// The first event from the platform that is not due yet.
+Event held_event;
+bool holding_event = false;
+
+bool invaders_start_recording(const char *filename)
+{
+    record_file = fopen(filename, "wb");
+    return record_file != NULL;
+}
+
+bool invaders_start_playback(const char *filename)
+{
+    playback_file = fopen(filename, "rb");
+    return playback_file != NULL;
+}
+
+bool write_u32(FILE *file, uint32_t value)
+{
+    return fwrite(&value, sizeof(value), 1, file) == 1;
+}
+
+bool read_u32(FILE *file, uint32_t *value)
+{
+    return fread(value, sizeof(*value), 1, file) == 1;
+}
+
+// Called before the world is built, so a replay can restore its settings
+// and seed.
+void begin_input_log(int32_t *seed)
+{
+    if (record_file)
+    {
+        uint32_t tick_bits;
+        memcpy(&tick_bits, &tick_dt, sizeof(tick_bits));
+
+        write_u32(record_file, input_log_magic);
+        write_u32(record_file, input_log_version);
+        write_u32(record_file, (uint32_t)*seed);
+        write_u32(record_file, tick_bits);
+        write_u32(record_file, (uint32_t)particle_pool_max);
+    }
+
+    if (playback_file)
+    {
+        uint32_t magic, version, log_seed, tick_bits, pool_max;
+        if (!read_u32(playback_file, &magic) || magic != input_log_magic ||
+            !read_u32(playback_file, &version) || version != input_log_version ||
+            !read_u32(playback_file, &log_seed) ||
+            !read_u32(playback_file, &tick_bits) ||
+            !read_u32(playback_file, &pool_max))
+        {
+            fprintf(stderr, "Not a valid input log\n");
+            fclose(playback_file);
+            playback_file = NULL;
+            should_quit_game = true;
+            return;
+        }
+
+        *seed = (int32_t)log_seed;
+        memcpy(&tick_dt, &tick_bits, sizeof(tick_dt));
+        particle_pool_max = (int)pool_max;
+    }
+}
+
+// Replaces the frame's delta with the recorded one and queues its events.
+// Returns false at the end of the log.
+bool read_input_frame(double *delta)
+{
+    uint16_t count = 0;
+    if (fread(delta, sizeof(*delta), 1, playback_file) != 1 ||
+        fread(&count, sizeof(count), 1, playback_file) != 1 ||
+        count > frame_event_max)
+    {
+        return false;
+    }
+
+    for (int i = 0; i < count; i++)
+    {
+        uint8_t bytes[4];
+        if (fread(bytes, sizeof(bytes), 1, playback_file) != 1)
+            return false;
+
+        frame_events[i].type = (EventType)bytes[0];
+        frame_events[i].key_code = (KeyCode)bytes[1];
+        frame_events[i].key_pressed = bytes[2] != 0;
+        frame_events[i].time = 0;
+        frame_event_ticks[i] = bytes[3];
+    }
+
+    frame_event_count = count;
+    frame_event_next = 0;
+    return true;
+}
+
+void write_input_frame(double delta)
+{
+    uint16_t count = (uint16_t)frame_event_count;
+    fwrite(&delta, sizeof(delta), 1, record_file);
+    fwrite(&count, sizeof(count), 1, record_file);
+
+    for (int i = 0; i < frame_event_count; i++)
+    {
+        uint8_t bytes[4];
+        bytes[0] = (uint8_t)frame_events[i].type;
+        bytes[1] = (uint8_t)frame_events[i].key_code;
+        bytes[2] = frame_events[i].key_pressed ? 1 : 0;
+        bytes[3] = frame_event_ticks[i];
+        fwrite(bytes, sizeof(bytes), 1, record_file);
+    }
+}
+
+void end_input_log()
+{
+    if (record_file)
+    {
+        fclose(record_file);
+        record_file = NULL;
+    }
+    if (playback_file)
+    {
+        fclose(playback_file);
+        playback_file = NULL;
+    }
+}
+
+// Returns the next event stamped no later than until, to be applied before
+// tick of the current frame. Later events stay queued for a later tick.
+bool next_input_event(Event *event, double until, int tick)
+{
+    if (playback_file)
+    {
+        if (frame_event_next < frame_event_count && frame_event_ticks[frame_event_next] <= tick)
+        {
+            *event = frame_events[frame_event_next++];
+            return true;
+        }
+        return false;
+    }
+
+    // Leave anything past the per-frame limit queued for the next frame, so
+    // every record holds exactly what was applied.
+    if (record_file && frame_event_count == frame_event_max)
+    {
+        return false;
+    }
+
+    if (!holding_event)
+    {
+        if (!get_next_event(&held_event))
+            return false;
+        holding_event = true;
+    }
+    if (held_event.time > until)
+    {
+        return false;
+    }
+
+    *event = held_event;
+    holding_event = false;
+    if (record_file)
+    {
+        frame_events[frame_event_count] = *event;
+        frame_event_ticks[frame_event_count] = (uint8_t)tick;
+        frame_event_count++;
+    }
+    return true;
+}
+
+// World snapshots. Only live entities are stored, pointers are stored as
+// indices, and the particle pool is copied stream by stream, so taking or
+// restoring a snapshot is a handful of memcpys.
+
+const uint32_t snapshot_magic = 0x534e5649; // "IVNS"
+const uint32_t snapshot_version = 4;
+
+struct Snapshot_Cursor
+{
+    uint8_t *at;
+    uint8_t *end;
+};
+
+bool put_bytes(Snapshot_Cursor *cursor, const void *data, size_t size)
+{
+    if ((size_t)(cursor->end - cursor->at) < size)
+        return false;
+    memcpy(cursor->at, data, size);
+    cursor->at += size;
+    return true;
+}
+
+bool get_bytes(Snapshot_Cursor *cursor, void *data, size_t size)
+{
+    if ((size_t)(cursor->end - cursor->at) < size)
+        return false;
+    memcpy(data, cursor->at, size);
+    cursor->at += size;
+    return true;
+}
+
+struct Snapshot_Header
+{
+    uint32_t magic;
+    uint32_t version;
+
+    Rng_Key rng_key;
+    uint32_t tick;
+    uint32_t next_entity_id;
+    int32_t key_left, key_right, key_up, key_down;
+    int32_t num_shots_fired;
+    int32_t num_invaders_destroyed;
+    int32_t num_ship_hits;
+
+    Vector2 ship_position;
+    Vector2 ship_previous_position;
+
+    double tick_accumulator;
+    float current_dt;
+    float render_alpha;
+    float auto_fire_remainder;
+
+    int32_t bullet_count;
+    int32_t live_invader_count;
+    int32_t live_emitter_count;
+    int32_t free_emitter_count;
+    int32_t projectile_count;
+    int32_t particle_count;
+};
+
+struct Snapshot_Bullet
+{
+    Vector2 position;
+    Vector2 previous_position;
+    Vector2 velocity;
+    Vector4 color;
+    int32_t emitter;
+};
+
+struct Snapshot_Invader
+{
+    Vector2 position;
+    Vector2 previous_position;
+    Vector2 velocity;
+    Vector2 target_position;
+    float sleep_countdown;
+    float fire_countdown;
+    uint32_t id;
+    int16_t bitmap;
+    uint8_t destroyed;
+};
+
+size_t snapshot_size()
+{
+    return sizeof(Snapshot_Header) +
+           world->bullet_count * sizeof(Snapshot_Bullet) +
+           world->live_invader_count * sizeof(Snapshot_Invader) +
+           world->live_emitter_count * (sizeof(int16_t) + sizeof(Particle_Emitter)) +
+           world->free_emitter_count * sizeof(int16_t) +
+           world->projectiles.count * (4 * sizeof(float) + sizeof(int16_t)) +
+           world->particle_pool.count * (8 * sizeof(float) + sizeof(Vector4) + sizeof(int16_t));
+}
+
+size_t save_snapshot(void *buffer, size_t capacity)
+{
+    Particle_Pool *p = &world->particle_pool;
+    Snapshot_Cursor cursor = {(uint8_t *)buffer, (uint8_t *)buffer + capacity};
+    if (capacity < snapshot_size())
+        return 0;
+
+    Snapshot_Header header = {};
+    header.magic = snapshot_magic;
+    header.version = snapshot_version;
+    header.rng_key = world->rng_key;
+    header.tick = world->tick;
+    header.next_entity_id = world->next_entity_id;
+    header.key_left = world->key_left;
+    header.key_right = world->key_right;
+    header.key_up = world->key_up;
+    header.key_down = world->key_down;
+    header.num_shots_fired = world->num_shots_fired;
+    header.num_invaders_destroyed = world->num_invaders_destroyed;
+    header.num_ship_hits = world->num_ship_hits;
+    header.ship_position = world->ship_position;
+    header.ship_previous_position = world->ship_previous_position;
+    header.tick_accumulator = tick_accumulator;
+    header.current_dt = world->current_dt;
+    header.render_alpha = render_alpha;
+    header.auto_fire_remainder = world->auto_fire_remainder;
+    header.bullet_count = world->bullet_count;
+    header.live_invader_count = world->live_invader_count;
+    header.live_emitter_count = world->live_emitter_count;
+    header.free_emitter_count = world->free_emitter_count;
+    header.projectile_count = world->projectiles.count;
+    header.particle_count = p->count;
+    put_bytes(&cursor, &header, sizeof(header));
+
+    for (int i = 0; i < world->bullet_count; i++)
+    {
+        Bullet *bullet = &world->bullets[i];
+        Snapshot_Bullet out;
+        out.position = bullet->position;
+        out.previous_position = bullet->previous_position;
+        out.velocity = bullet->velocity;
+        out.color = bullet->color;
+        out.emitter = bullet->emitter ? (int32_t)(bullet->emitter - world->emitters) : -1;
+        put_bytes(&cursor, &out, sizeof(out));
+    }
+
+    for (int i = 0; i < world->live_invader_count; i++)
+    {
+        Invader *invader = &world->live_invaders[i];
+        Snapshot_Invader out;
+        out.position = invader->position;
+        out.previous_position = invader->previous_position;
+        out.velocity = invader->velocity;
+        out.target_position = invader->target_position;
+        out.sleep_countdown = invader->sleep_countdown;
+        out.fire_countdown = invader->fire_countdown;
+        out.id = invader->id;
+        out.bitmap = invader->bitmap ? (int16_t)(invader->bitmap - invader_bitmaps) : -1;
+        out.destroyed = invader->destroyed ? 1 : 0;
+        put_bytes(&cursor, &out, sizeof(out));
+    }
+
+    // Emitters in live order with their slots, then the free stack, so the
+    // restored world hands out the same slots in the same order.
+    for (int i = 0; i < world->live_emitter_count; i++)
+    {
+        int16_t slot = (int16_t)world->live_emitters[i];
+        put_bytes(&cursor, &slot, sizeof(slot));
+        put_bytes(&cursor, &world->emitters[slot], sizeof(Particle_Emitter));
+    }
+    for (int i = 0; i < world->free_emitter_count; i++)
+    {
+        int16_t slot = (int16_t)world->free_emitters[i];
+        put_bytes(&cursor, &slot, sizeof(slot));
+    }
+
+    Projectile_Pool *projectiles = &world->projectiles;
+    int projectile_count = projectiles->count;
+    put_bytes(&cursor, projectiles->position_x, projectile_count * sizeof(float));
+    put_bytes(&cursor, projectiles->position_y, projectile_count * sizeof(float));
+    put_bytes(&cursor, projectiles->velocity_x, projectile_count * sizeof(float));
+    put_bytes(&cursor, projectiles->velocity_y, projectile_count * sizeof(float));
+    for (int i = 0; i < projectile_count; i++)
+    {
+        int16_t trail = (int16_t)projectiles->emitter[i];
+        memcpy(cursor.at + i * sizeof(int16_t), &trail, sizeof(trail));
+    }
+    cursor.at += projectile_count * sizeof(int16_t);
+
+    int n = p->count;
+    put_bytes(&cursor, p->position_x, n * sizeof(float));
+    put_bytes(&cursor, p->position_y, n * sizeof(float));
+    put_bytes(&cursor, p->velocity_x, n * sizeof(float));
+    put_bytes(&cursor, p->velocity_y, n * sizeof(float));
+    put_bytes(&cursor, p->drag, n * sizeof(float));
+    put_bytes(&cursor, p->elapsed, n * sizeof(float));
+    put_bytes(&cursor, p->lifetime, n * sizeof(float));
+    put_bytes(&cursor, p->size, n * sizeof(float));
+    put_bytes(&cursor, p->color, n * sizeof(Vector4));
+    for (int i = 0; i < n; i++)
+    {
+        int16_t owner = (int16_t)p->emitter[i];
+        memcpy(cursor.at + i * sizeof(int16_t), &owner, sizeof(owner));
+    }
+    cursor.at += n * sizeof(int16_t);
+
+    return cursor.at - (uint8_t *)buffer;
+}
+
+// Every emitter slot must appear exactly once across the live list and the
+// free stack, and every reference must name a live emitter. slot_live and
+// slot_seen hold one zeroed entry per emitter slot.
+bool check_snapshot_references(const Snapshot_Header *header, Snapshot_Cursor cursor, bool *slot_live, bool *slot_seen)
+{
+    int emitter_capacity = world->emitter_capacity;
+
+    Snapshot_Cursor scan = cursor;
+    scan.at += header->bullet_count * sizeof(Snapshot_Bullet) +
+               header->live_invader_count * sizeof(Snapshot_Invader);
+    for (int i = 0; i < header->live_emitter_count + header->free_emitter_count; i++)
+    {
+        int16_t slot = -1;
+        get_bytes(&scan, &slot, sizeof(slot));
+        if (slot < 0 || slot >= emitter_capacity || slot_seen[slot])
+            return false;
+        slot_seen[slot] = true;
+        slot_live[slot] = i < header->live_emitter_count;
+        if (slot_live[slot])
+            scan.at += sizeof(Particle_Emitter);
+    }
+
+    Snapshot_Cursor check = cursor;
+    for (int i = 0; i < header->bullet_count; i++)
+    {
+        Snapshot_Bullet in;
+        get_bytes(&check, &in, sizeof(in));
+        if (in.emitter < -1 || in.emitter >= emitter_capacity || (in.emitter >= 0 && !slot_live[in.emitter]))
+            return false;
+    }
+    for (int i = 0; i < header->live_invader_count; i++)
+    {
+        Snapshot_Invader in;
+        get_bytes(&check, &in, sizeof(in));
+        if (in.bitmap < -1 || in.bitmap >= invader_bitmap_count)
+            return false;
+    }
+    const uint8_t *owners = cursor.end - header->particle_count * sizeof(int16_t);
+    const uint8_t *trails = owners - header->particle_count * (8 * sizeof(float) + sizeof(Vector4)) -
+                            header->projectile_count * sizeof(int16_t);
+    for (int i = 0; i < header->projectile_count; i++)
+    {
+        int16_t trail;
+        memcpy(&trail, trails + i * sizeof(int16_t), sizeof(trail));
+        if (trail < -1 || trail >= emitter_capacity || (trail >= 0 && !slot_live[trail]))
+            return false;
+    }
+    for (int i = 0; i < header->particle_count; i++)
+    {
+        int16_t owner;
+        memcpy(&owner, owners + i * sizeof(int16_t), sizeof(owner));
+        if (owner < 0 || owner >= emitter_capacity || !slot_live[owner])
+            return false;
+    }
+    return true;
+}
+
+// Restores the world from a snapshot taken by save_snapshot. The snapshot is
+// validated completely before anything is changed, so a bad one leaves the
+// world as it was.
+bool load_snapshot(const void *data, size_t size)
+{
+    Particle_Pool *p = &world->particle_pool;
+    Projectile_Pool *projectiles = &world->projectiles;
+    Snapshot_Cursor cursor = {(uint8_t *)data, (uint8_t *)data + size};
+
+    Snapshot_Header header;
+    if (!get_bytes(&cursor, &header, sizeof(header)) ||
+        header.magic != snapshot_magic || header.version != snapshot_version ||
+        header.bullet_count < 0 || header.bullet_count > world->bullet_capacity ||
+        header.live_invader_count < 0 || header.live_invader_count > world->invader_capacity ||
+        header.live_emitter_count < 0 || header.free_emitter_count < 0 ||
+        header.live_emitter_count + header.free_emitter_count != world->emitter_capacity ||
+        header.projectile_count < 0 || header.projectile_count > projectiles->capacity ||
+        header.particle_count < 0 || header.particle_count > p->capacity)
+    {
+        return false;
+    }
+
+    size_t expected = sizeof(Snapshot_Header) +
+                      header.bullet_count * sizeof(Snapshot_Bullet) +
+                      header.live_invader_count * sizeof(Snapshot_Invader) +
+                      header.live_emitter_count * (sizeof(int16_t) + sizeof(Particle_Emitter)) +
+                      header.free_emitter_count * sizeof(int16_t) +
+                      header.projectile_count * (4 * sizeof(float) + sizeof(int16_t)) +
+                      header.particle_count * (8 * sizeof(float) + sizeof(Vector4) + sizeof(int16_t));
+    if (size != expected)
+    {
+        return false;
+    }
+
+    int emitter_capacity = world->emitter_capacity;
+    bool *slots = (bool *)calloc(2 * emitter_capacity, sizeof(bool));
+    bool valid = check_snapshot_references(&header, cursor, slots, slots + emitter_capacity);
+    free(slots);
+    if (!valid)
+    {
+        return false;
+    }
+
+    const uint8_t *owners = cursor.end - header.particle_count * sizeof(int16_t);
+    const uint8_t *trails = owners - header.particle_count * (8 * sizeof(float) + sizeof(Vector4)) -
+                            header.projectile_count * sizeof(int16_t);
+
+    world->rng_key = header.rng_key;
+    world->tick = header.tick;
+    world->next_entity_id = header.next_entity_id;
+    world->key_left = header.key_left;
+    world->key_right = header.key_right;
+    world->key_up = header.key_up;
+    world->key_down = header.key_down;
+    world->num_shots_fired = header.num_shots_fired;
+    world->num_invaders_destroyed = header.num_invaders_destroyed;
+    world->num_ship_hits = header.num_ship_hits;
+    world->ship_position = header.ship_position;
+    world->ship_previous_position = header.ship_previous_position;
+    tick_accumulator = header.tick_accumulator;
+    world->current_dt = header.current_dt;
+    render_alpha = header.render_alpha;
+    world->auto_fire_remainder = header.auto_fire_remainder;
+
+    world->bullet_count = header.bullet_count;
+    for (int i = 0; i < world->bullet_count; i++)
+    {
+        Snapshot_Bullet in;
+        get_bytes(&cursor, &in, sizeof(in));
+        Bullet *bullet = &world->bullets[i];
+        bullet->position = in.position;
+        bullet->previous_position = in.previous_position;
+        bullet->velocity = in.velocity;
+        bullet->color = in.color;
+        bullet->emitter = in.emitter >= 0 ? &world->emitters[in.emitter] : NULL;
+    }
+
+    world->live_invader_count = header.live_invader_count;
+    for (int i = 0; i < world->live_invader_count; i++)
+    {
+        Snapshot_Invader in;
+        get_bytes(&cursor, &in, sizeof(in));
+        Invader *invader = &world->live_invaders[i];
+        invader->position = in.position;
+        invader->previous_position = in.previous_position;
+        invader->velocity = in.velocity;
+        invader->target_position = in.target_position;
+        invader->sleep_countdown = in.sleep_countdown;
+        invader->fire_countdown = in.fire_countdown;
+        invader->id = in.id;
+        invader->bitmap = in.bitmap >= 0 ? &invader_bitmaps[in.bitmap] : NULL;
+        invader->destroyed = in.destroyed != 0;
+    }
+
+    for (int i = 0; i < world->emitter_capacity; i++)
+    {
+        world->emitters[i].alive = false;
+    }
+
+    world->live_emitter_count = header.live_emitter_count;
+    for (int i = 0; i < world->live_emitter_count; i++)
+    {
+        int16_t slot = -1;
+        get_bytes(&cursor, &slot, sizeof(slot));
+        get_bytes(&cursor, &world->emitters[slot], sizeof(Particle_Emitter));
+        world->emitters[slot].live_index = i;
+        world->live_emitters[i] = slot;
+    }
+
+    world->free_emitter_count = header.free_emitter_count;
+    for (int i = 0; i < world->free_emitter_count; i++)
+    {
+        int16_t slot = -1;
+        get_bytes(&cursor, &slot, sizeof(slot));
+        world->free_emitters[i] = slot;
+    }
+
+    // Contrails are linked back to their projectiles here rather than
+    // trusted from the emitter records.
+    for (int i = 0; i < world->emitter_capacity; i++)
+    {
+        world->emitters[i].projectile = -1;
+    }
+    int projectile_count = header.projectile_count;
+    projectiles->count = projectile_count;
+    get_bytes(&cursor, projectiles->position_x, projectile_count * sizeof(float));
+    get_bytes(&cursor, projectiles->position_y, projectile_count * sizeof(float));
+    get_bytes(&cursor, projectiles->velocity_x, projectile_count * sizeof(float));
+    get_bytes(&cursor, projectiles->velocity_y, projectile_count * sizeof(float));
+    for (int i = 0; i < projectile_count; i++)
+    {
+        int16_t trail;
+        memcpy(&trail, trails + i * sizeof(int16_t), sizeof(trail));
+        projectiles->emitter[i] = trail;
+        if (trail >= 0)
+        {
+            world->emitters[trail].projectile = i;
+        }
+    }
+    cursor.at += projectile_count * sizeof(int16_t);
+
+    int n = header.particle_count;
+    p->count = n;
+    get_bytes(&cursor, p->position_x, n * sizeof(float));
+    get_bytes(&cursor, p->position_y, n * sizeof(float));
+    get_bytes(&cursor, p->velocity_x, n * sizeof(float));
+    get_bytes(&cursor, p->velocity_y, n * sizeof(float));
+    get_bytes(&cursor, p->drag, n * sizeof(float));
+    get_bytes(&cursor, p->elapsed, n * sizeof(float));
+    get_bytes(&cursor, p->lifetime, n * sizeof(float));
+    get_bytes(&cursor, p->size, n * sizeof(float));
+    get_bytes(&cursor, p->color, n * sizeof(Vector4));
+    for (int i = 0; i < n; i++)
+    {
+        int16_t owner;
+        memcpy(&owner, owners + i * sizeof(int16_t), sizeof(owner));
+        p->emitter[i] = owner;
+    }
+
+    return true;
+}
+
+const void *start_snapshot = NULL;
+size_t start_snapshot_size = 0;
+
+void invaders_start_from_snapshot(const void *data, size_t size)
+{
+    start_snapshot = data;
+    start_snapshot_size = size;
+}
+
+// Applies the input that arrived up to wall-clock time until, ahead of the
+// frame's tick-th tick.
+void process_events(double until, int tick)
+{
+    PROFILE_ZONE("process_events");
+
+    while (1)
+    {
+        Event event;
+        bool received = next_input_event(&event, until, tick);
+        if (!received)
+            break;
+
+        if (event.type == EVENT_TYPE_QUIT)
+        {
+            should_quit_game = true;
+            return;
+        }
+
+        if (event.type == EVENT_TYPE_KEYBOARD)
+        {
+            if (event.key_code == KEY_ARROW_LEFT)
+            {
+                world->key_left = event.key_pressed;
+            }
+            if (event.key_code == KEY_ARROW_RIGHT)
+            {
+                world->key_right = event.key_pressed;
+            }
+            if (event.key_code == KEY_ARROW_DOWN)
+            {
+                world->key_down = event.key_pressed;
+            }
+            if (event.key_code == KEY_ARROW_UP)
+            {
+                world->key_up = event.key_pressed;
+            }
+            if (event.key_code == KEY_SHIFT)
+            {
+                if (event.key_pressed)
+                {
+                    do_fire_bullets();
+                }
+            }
+            if (event.key_code == KEY_ESCAPE)
+            {
+                if (event.key_pressed)
+                {
+                    should_quit_game = true;
+                }
+            }
+            if (event.key_code == KEY_F1)
+            {
+                if (event.key_pressed)
+                {
+                    if (profile_trace_active())
+                    {
+                        profile_trace_stop();
+                    }
+                    else
+                    {
+                        profile_trace_start("invaders-trace.json");
+                    }
+                }
+            }
+        }
+    }
+}
+
+// Starts a new game in the current world, which alloc_world must already
+// have sized; its capacities are kept.
+void reset_world(int32_t seed)
+{
+    World *w = world;
+    w->key_left = 0;
+    w->key_right = 0;
+    w->key_up = 0;
+    w->key_down = 0;
+    w->current_dt = tick_dt;
+    w->num_shots_fired = 0;
+    w->num_invaders_destroyed = 0;
+    w->num_ship_hits = 0;
+    w->bullet_count = 0;
+    w->live_invader_count = 0;
+    w->particle_pool.count = 0;
+    w->projectiles.count = 0;
+    w->auto_fire_remainder = 0;
+    init_emitters();
+
+    w->rng_key = rng_key((uint32_t)seed);
+    w->tick = 0;
+    w->next_entity_id = 1;
+    for (int i = 0; i < num_desired_invaders; i++)
+    {
+        add_invader();
+    }
+
+    w->ship_position.x = 0.5f;
+    w->ship_position.y = 0.1f;
+    w->ship_previous_position = w->ship_position;
+}
+
+void save_previous_positions()
+{
+    world->ship_previous_position = world->ship_position;
+    for (int i = 0; i < world->bullet_count; i++)
+    {
+        world->bullets[i].previous_position = world->bullets[i].position;
+    }
+    for (int i = 0; i < world->live_invader_count; i++)
+    {
+        world->live_invaders[i].previous_position = world->live_invaders[i].position;
+    }
+}
+
+// When set, simulate_tick adds the wall-clock time of each phase to it.
+double *phase_seconds = NULL;
+
+void run_phase(Sim_Phase phase, void (*body)())
+{
+    if (!phase_seconds)
+    {
+        body();
+        return;
+    }
+
+    double start = get_time();
+    body();
+    phase_seconds[phase] += get_time() - start;
+}
+
+void simulate_tick(float dt)
+{
+    PROFILE_ZONE("simulate_tick");
+
+    world->current_dt = dt;
+
+    if (world->live_invader_count < num_desired_invaders)
+    {
+        add_invader();
+    }
+
+    float dmove = 0.3f * world->current_dt;
+    float x0 = 0.01f;
+    float x1 = 0.99f;
+    float y0 = 0.02f;
+    float y1 = 0.15f;
+
+    if (world->key_left)
+    {
+        world->ship_position.x -= dmove;
+    }
+    if (world->key_right)
+    {
+        world->ship_position.x += dmove;
+    }
+    if (world->key_down)
+    {
+        world->ship_position.y -= dmove;
+    }
+    if (world->key_up)
+    {
+        world->ship_position.y += dmove;
+    }
+
+    if (world->ship_position.x < x0)
+    {
+        world->ship_position.x = x0;
+    }
+    if (world->ship_position.x > x1)
+    {
+        world->ship_position.x = x1;
+    }
+    if (world->ship_position.y < y0)
+    {
+        world->ship_position.y = y0;
+    }
+    if (world->ship_position.y > y1)
+    {
+        world->ship_position.y = y1;
+    }
+    if (auto_fire_rate > 0)
+    {
+        world->auto_fire_remainder += auto_fire_rate * world->current_dt;
+        while (world->auto_fire_remainder >= 1.0f)
+        {
+            world->auto_fire_remainder -= 1.0f;
+            do_fire_bullets();
+        }
+    }
+
+    run_phase(PHASE_BULLETS, simulate_bullets);
+    run_phase(PHASE_INVADERS, simulate_invaders);
+    run_phase(PHASE_PROJECTILES, simulate_projectiles);
+    run_phase(PHASE_EMITTERS, simulate_emitters);
+
+    world->tick++;
+}
+
+// Advances the game by one frame; returns the number of fixed ticks run.
+int invaders_simulate()
+{
+    PROFILE_ZONE("invaders_simulate");
+
+    double now = get_time();
+
+    double delta = now - last_time;
+    if (fixed_dt > 0)
+    {
+        delta = fixed_dt;
+    }
+
+    last_time = now;
+
+    if (playback_file)
+    {
+        if (!read_input_frame(&delta))
+        {
+            should_quit_game = true;
+            return 0;
+        }
+    }
+    else
+    {
+        frame_event_count = 0;
+    }
+
+    // Run however many fixed ticks the elapsed time covers. After a hitch,
+    // catching up is capped and the rest of the backlog is dropped.
+    tick_accumulator += delta;
+
+    // Each tick covers a slice of wall-clock time, and gets the input
+    // stamped within it, so a key press lands on the tick it happened in
+    // rather than at the next frame. With a fixed dt the clocks are
+    // unrelated, and everything queued goes to the first tick.
+    double tick_start = now - tick_accumulator;
+
+    int ticks = 0;
+    while (tick_accumulator >= tick_dt)
+    {
+        if (ticks == max_ticks_per_frame)
+        {
+            tick_accumulator = fmod(tick_accumulator, (double)tick_dt);
+            break;
+        }
+
+        double until = fixed_dt > 0 ? DBL_MAX : tick_start + tick_dt;
+        process_events(until, ticks);
+        if (should_quit_game)
+        {
+            break;
+        }
+
+        save_previous_positions();
+        simulate_tick(tick_dt);
+
+        tick_accumulator -= tick_dt;
+        tick_start += tick_dt;
+        ticks++;
+    }
+
+    if (record_file)
+    {
+        write_input_frame(delta);
+    }
+
+    render_alpha = (float)(tick_accumulator / tick_dt);
+
+    return ticks;
+}
+
+void init_gl_for_bitmap(Bitmap *bitmap)
+{
+    glGenTextures(1, &bitmap->id);
+    glBindTexture(GL_TEXTURE_2D, bitmap->id);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, bitmap->width, bitmap->height, 0, GL_RGBA, GL_UNSIGNED_BYTE, bitmap->data);
+    glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    bitmap->u0 = 0;
+    bitmap->v0 = 0;
+    bitmap->u1 = 1;
+    bitmap->v1 = 1;
+}
+
+bool load_bitmap(const char *filename, Bitmap *result)
+{
+    int width = 0;
+    int height = 0;
+
+    uint8_t *data = stbi_load(filename, &width, &height, NULL, 4);
+    if (!data)
+    {
+        fprintf(stderr, "Could not load '%s': %s\n", filename, stbi_failure_reason());
+        return false;
+    }
+
+    result->width = width;
+    result->height = height;
+    result->data = data;
+    return true;
+}
+
+// Every sprite the game draws. They are all packed into one atlas texture at
+// startup, so drawing never has to switch textures.
+struct Sprite_Source
+{
+    const char *filename;
+    Bitmap *bitmap;
+};
+
+Sprite_Source sprite_sources[] = {
+    {"ship.png", &ship_bitmap},
+    {"bullet.png", &bullet_bitmap},
+    {"contrail.png", &contrail_bitmap},
+    {"bug1.png", &invader_bitmaps[0]},
+    {"bug2.png", &invader_bitmaps[1]},
+    {"bug3.png", &invader_bitmaps[2]},
+    {"bug4.png", &invader_bitmaps[3]},
+};
+
+const int sprite_source_count = sizeof(sprite_sources) / sizeof(sprite_sources[0]);
+
+Atlas sprite_atlas;
+Bitmap atlas_bitmap;
+
+// A single white texel in the atlas, for quads that only want vertex color.
+Bitmap white_bitmap;
+
+void set_atlas_region(Bitmap *bitmap, Atlas_Rect rect)
+{
+    float iw = 1.0f / sprite_atlas.width;
+    float ih = 1.0f / sprite_atlas.height;
+
+    bitmap->id = atlas_bitmap.id;
+    bitmap->u0 = rect.x * iw;
+    bitmap->v0 = rect.y * ih;
+    bitmap->u1 = (rect.x + rect.width) * iw;
+    bitmap->v1 = (rect.y + rect.height) * ih;
+}
+
+// Built by pack-assets.cpp from the same images. When it is present the
+// atlas is uploaded straight out of a mapping of the file, with no PNG
+// decode and no copy on the heap; the mapping stays for the whole run.
+const char *asset_pack_filename = "invaders.pak";
+void *asset_pack = NULL;
+size_t asset_pack_size = 0;
+
+// Fills rects for every sprite source, then the white texel, from the pack.
+// Returns false, leaving nothing mapped, if there is no pack or it does not
+// hold every sprite.
+bool load_asset_pack(Atlas_Rect *rects)
+{
+    size_t size = 0;
+    uint8_t *data = (uint8_t *)map_file(asset_pack_filename, &size);
+    if (!data)
+        return false;
+
+    Asset_Pack_Header header = {};
+    if (size >= sizeof(header))
+    {
+        memcpy(&header, data, sizeof(header));
+    }
+
+    size_t entries_end = sizeof(header) + (size_t)header.entry_count * sizeof(Asset_Pack_Entry);
+    size_t atlas_bytes = (size_t)header.atlas_width * header.atlas_height * 4;
+    bool valid = header.magic == asset_pack_magic && header.version == asset_pack_version &&
+                 header.entry_count <= (size - sizeof(header)) / sizeof(Asset_Pack_Entry) &&
+                 header.atlas_width >= 1 && header.atlas_width <= (uint32_t)atlas_max_size &&
+                 header.atlas_height >= 1 && header.atlas_height <= (uint32_t)atlas_max_size &&
+                 header.padding == (uint32_t)atlas_padding &&
+                 header.atlas_offset % asset_pack_alignment == 0 &&
+                 header.atlas_offset >= entries_end && header.atlas_offset <= size &&
+                 atlas_bytes <= size - header.atlas_offset;
+
+    const Asset_Pack_Entry *entries = (const Asset_Pack_Entry *)(data + sizeof(header));
+    for (int i = 0; valid && i <= sprite_source_count; i++)
+    {
+        const char *name = i < sprite_source_count ? sprite_sources[i].filename : "white";
+        const Asset_Pack_Entry *entry = NULL;
+        for (uint32_t e = 0; e < header.entry_count && !entry; e++)
+        {
+            if (strncmp(entries[e].name, name, asset_pack_name_max) == 0)
+            {
+                entry = &entries[e];
+            }
+        }
+
+        // The padding around the rect must fit in the atlas as well.
+        valid = entry && entry->width >= 0 && entry->height >= 0 &&
+                entry->x >= atlas_padding && entry->y >= atlas_padding &&
+                (int64_t)entry->x + entry->width + atlas_padding <= (int64_t)header.atlas_width &&
+                (int64_t)entry->y + entry->height + atlas_padding <= (int64_t)header.atlas_height;
+        if (valid)
+        {
+            rects[i].x = entry->x;
+            rects[i].y = entry->y;
+            rects[i].width = entry->width;
+            rects[i].height = entry->height;
+        }
+    }
+
+    if (!valid)
+    {
+        fprintf(stderr, "'%s' is not a usable asset pack, loading the images instead\n", asset_pack_filename);
+        unmap_file(data, size);
+        return false;
+    }
+
+    asset_pack = data;
+    asset_pack_size = size;
+    sprite_atlas.width = (int)header.atlas_width;
+    sprite_atlas.height = (int)header.atlas_height;
+    sprite_atlas.data = data + header.atlas_offset;
+    return true;
+}
+
+Startup_Stats startup_stats;
+
+void decode_sprites(void *, int first, int end)
+{
+    for (int i = first; i < end; i++)
+    {
+        load_bitmap(sprite_sources[i].filename, sprite_sources[i].bitmap);
+    }
+}
+
+// Decodes every sprite, one per job, and packs them into a new atlas. If
+// they do not fit, each sprite gets a texture of its own and this returns
+// false.
+bool build_sprite_atlas(Atlas_Rect *rects)
+{
+    Atlas_Image images[sprite_source_count + 1] = {};
+
+    parallel_for(sprite_source_count, 1, decode_sprites, NULL);
+    for (int i = 0; i < sprite_source_count; i++)
+    {
+        Bitmap *bitmap = sprite_sources[i].bitmap;
+        if (bitmap->data)
+        {
+            images[i].width = bitmap->width;
+            images[i].height = bitmap->height;
+            images[i].data = bitmap->data;
+        }
+    }
+
+    static const uint8_t white[4] = {255, 255, 255, 255};
+    int white_index = sprite_source_count;
+    images[white_index].width = 1;
+    images[white_index].height = 1;
+    images[white_index].data = white;
+
+    if (!build_atlas(images, sprite_source_count + 1, atlas_padding, atlas_max_size, &sprite_atlas, rects))
+    {
+        fprintf(stderr, "Sprites do not fit in a %dx%d atlas\n", atlas_max_size, atlas_max_size);
+        double upload_start = get_time();
+        for (int i = 0; i < sprite_source_count; i++)
+        {
+            if (sprite_sources[i].bitmap->data)
+            {
+                init_gl_for_bitmap(sprite_sources[i].bitmap);
+            }
+        }
+        startup_stats.upload = get_time() - upload_start;
+        return false;
+    }
+
+    for (int i = 0; i < sprite_source_count; i++)
+    {
+        // The atlas holds the only copy the game needs.
+        Bitmap *bitmap = sprite_sources[i].bitmap;
+        stbi_image_free(bitmap->data);
+        bitmap->data = NULL;
+    }
+    return true;
+}
+
+// Where each sprite, then the white texel, sits in the atlas, and whether
+// there is an atlas at all.
+Atlas_Rect sprite_rects[sprite_source_count + 1];
+bool sprites_in_atlas = false;
+
+void set_sprite_regions(const Atlas_Rect *rects)
+{
+    memcpy(sprite_rects, rects, sizeof(sprite_rects));
+    sprites_in_atlas = true;
+
+    for (int i = 0; i < sprite_source_count; i++)
+    {
+        Bitmap *bitmap = sprite_sources[i].bitmap;
+        bitmap->width = rects[i].width;
+        bitmap->height = rects[i].height;
+        set_atlas_region(bitmap, rects[i]);
+    }
+
+    set_atlas_region(&white_bitmap, rects[sprite_source_count]);
+    float half_u = 0.5f / sprite_atlas.width;
+    float half_v = 0.5f / sprite_atlas.height;
+    white_bitmap.u0 += half_u;
+    white_bitmap.u1 = white_bitmap.u0;
+    white_bitmap.v0 += half_v;
+    white_bitmap.v1 = white_bitmap.v0;
+}
+
+void init_textures()
+{
+    Atlas_Rect rects[sprite_source_count + 1];
+
+    double start = get_time();
+    startup_stats.from_pack = load_asset_pack(rects);
+    bool packed = startup_stats.from_pack || build_sprite_atlas(rects);
+    startup_stats.assets = get_time() - start - startup_stats.upload;
+    if (!packed)
+    {
+        return;
+    }
+
+    // Uploads stay on this thread, which owns the GL context.
+    double upload_start = get_time();
+    atlas_bitmap.width = sprite_atlas.width;
+    atlas_bitmap.height = sprite_atlas.height;
+    atlas_bitmap.data = sprite_atlas.data;
+    init_gl_for_bitmap(&atlas_bitmap);
+    startup_stats.upload = get_time() - upload_start;
+
+    set_sprite_regions(rects);
+}
+
+// Sprite hot reload. When a sprite's file changes it is decoded on a thread
+// of its own, and the result is swapped in at the start of the next frame
+// after decoding finishes. A sprite that keeps its size is copied into its
+// atlas rect and only that rect is uploaded; one that changes size makes
+// the atlas be packed again from the texels it already holds.
+
+enum Reload_State
+{
+    RELOAD_IDLE,
+    RELOAD_DECODING,
+    RELOAD_DONE,
+};
+
+struct Sprite_Reload
+{
+    std::atomic<int> state;
+    bool again; // the file changed again while it was being decoded
+    std::thread thread;
+    Bitmap decoded;
+    bool decoded_ok;
+};
+
+Sprite_Reload sprite_reloads[sprite_source_count];
+bool hot_reload = false;
+
+void decode_sprite_reload(int index)
+{
+    Sprite_Reload *reload = &sprite_reloads[index];
+    reload->decoded = Bitmap();
+    reload->decoded_ok = load_bitmap(sprite_sources[index].filename, &reload->decoded);
+    reload->state.store(RELOAD_DONE, std::memory_order_release);
+}
+
+void start_sprite_reload(int index)
+{
+    Sprite_Reload *reload = &sprite_reloads[index];
+    if (reload->state.load(std::memory_order_acquire) != RELOAD_IDLE)
+    {
+        reload->again = true;
+        return;
+    }
+    reload->state.store(RELOAD_DECODING, std::memory_order_relaxed);
+    reload->thread = std::thread(decode_sprite_reload, index);
+}
+
+// Uploads rect, grown by the atlas padding, from the atlas to its texture.
+void upload_atlas_rect(Atlas_Rect rect)
+{
+    int x = rect.x - atlas_padding;
+    int y = rect.y - atlas_padding;
+    int width = rect.width + 2 * atlas_padding;
+    int height = rect.height + 2 * atlas_padding;
+
+    uint8_t *texels = (uint8_t *)malloc((size_t)width * height * 4);
+    for (int row = 0; row < height; row++)
+    {
+        memcpy(texels + (size_t)row * width * 4,
+               sprite_atlas.data + ((size_t)(y + row) * sprite_atlas.width + x) * 4, (size_t)width * 4);
+    }
+
+    glBindTexture(GL_TEXTURE_2D, atlas_bitmap.id);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, x, y, width, height, GL_RGBA, GL_UNSIGNED_BYTE, texels);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    free(texels);
+}
+
+// Packs a new atlas from the current one with sprite changed replaced by
+// data, and uploads it whole.
+bool repack_sprite_atlas(int changed, const Bitmap *data)
+{
+    const int count = sprite_source_count + 1;
+    Atlas_Image images[count];
+    Atlas_Rect rects[count];
+    uint8_t *copies[count] = {};
+
+    for (int i = 0; i < count; i++)
+    {
+        if (i == changed)
+        {
+            images[i].width = data->width;
+            images[i].height = data->height;
+            images[i].data = data->data;
+            continue;
+        }
+
+        Atlas_Rect rect = sprite_rects[i];
+        copies[i] = (uint8_t *)malloc((size_t)rect.width * rect.height * 4 + 1);
+        for (int row = 0; row < rect.height; row++)
+        {
+            memcpy(copies[i] + (size_t)row * rect.width * 4,
+                   sprite_atlas.data + ((size_t)(rect.y + row) * sprite_atlas.width + rect.x) * 4, (size_t)rect.width * 4);
+        }
+        images[i].width = rect.width;
+        images[i].height = rect.height;
+        images[i].data = copies[i];
+    }
+
+    Atlas atlas;
+    bool packed = build_atlas(images, count, atlas_padding, atlas_max_size, &atlas, rects);
+    for (int i = 0; i < count; i++)
+    {
+        free(copies[i]);
+    }
+    if (!packed)
+    {
+        fprintf(stderr, "Sprites do not fit in a %dx%d atlas\n", atlas_max_size, atlas_max_size);
+        return false;
+    }
+
+    if (asset_pack)
+    {
+        unmap_file(asset_pack, asset_pack_size);
+        asset_pack = NULL;
+    }
+    else
+    {
+        free_atlas(&sprite_atlas);
+    }
+    sprite_atlas = atlas;
+
+    atlas_bitmap.width = atlas.width;
+    atlas_bitmap.height = atlas.height;
+    atlas_bitmap.data = atlas.data;
+    glBindTexture(GL_TEXTURE_2D, atlas_bitmap.id);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, atlas.width, atlas.height, 0, GL_RGBA, GL_UNSIGNED_BYTE, atlas.data);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    set_sprite_regions(rects);
+    return true;
+}
+
+// Takes ownership of decoded's texels.
+void apply_sprite_reload(int index, Bitmap *decoded)
+{
+    Bitmap *bitmap = sprite_sources[index].bitmap;
+    if (!sprites_in_atlas)
+    {
+        // The sprite has a texture of its own; replace it whole.
+        stbi_image_free(bitmap->data);
+        bitmap->width = decoded->width;
+        bitmap->height = decoded->height;
+        bitmap->data = decoded->data;
+        if (!bitmap->id)
+        {
+            init_gl_for_bitmap(bitmap);
+            return;
+        }
+        glBindTexture(GL_TEXTURE_2D, bitmap->id);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, bitmap->width, bitmap->height, 0, GL_RGBA, GL_UNSIGNED_BYTE, bitmap->data);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        return;
+    }
+
+    Atlas_Rect rect = sprite_rects[index];
+    if (decoded->width == rect.width && decoded->height == rect.height)
+    {
+        blit_atlas_image(&sprite_atlas, rect, atlas_padding, decoded->data);
+        upload_atlas_rect(rect);
+    }
+    else
+    {
+        repack_sprite_atlas(index, decoded);
+    }
+    stbi_image_free(decoded->data);
+}
+
+// Called at the start of every frame.
+void update_sprite_reloads()
+{
+    if (!hot_reload)
+        return;
+
+    char name[256];
+    while (next_changed_file(name, sizeof(name)))
+    {
+        for (int i = 0; i < sprite_source_count; i++)
+        {
+            if (strcmp(name, sprite_sources[i].filename) == 0)
+            {
+                start_sprite_reload(i);
+            }
+        }
+    }
+
+    for (int i = 0; i < sprite_source_count; i++)
+    {
+        Sprite_Reload *reload = &sprite_reloads[i];
+        if (reload->state.load(std::memory_order_acquire) != RELOAD_DONE)
+            continue;
+
+        reload->thread.join();
+        if (reload->decoded_ok)
+        {
+            apply_sprite_reload(i, &reload->decoded);
+            fprintf(stderr, "Reloaded '%s'\n", sprite_sources[i].filename);
+        }
+        reload->state.store(RELOAD_IDLE, std::memory_order_relaxed);
+
+        if (reload->again)
+        {
+            reload->again = false;
+            start_sprite_reload(i);
+        }
+    }
+}
+
+void stop_sprite_reloads()
+{
+    for (int i = 0; i < sprite_source_count; i++)
+    {
+        Sprite_Reload *reload = &sprite_reloads[i];
+        if (reload->state.load(std::memory_order_acquire) == RELOAD_IDLE)
+            continue;
 
-        bullet->emitter->color0 = make_vector4(k0, k0, k0, 1);
-        bullet->emitter->color1 = make_vector4(k1, k1, k1, 1);
+        reload->thread.join();
+        if (reload->decoded_ok)
+        {
+            stbi_image_free(reload->decoded.data);
+        }
+        reload->state.store(RELOAD_IDLE, std::memory_order_relaxed);
     }
-
-    return bullet;
 }
 
-void do_fire_bullets()
-{
-    Bullet *left = fire_bullet();
-    Bullet *right = fire_bullet();
+// Sprites are recorded into a CPU vertex array during the frame and submitted
+// by batch_flush. Consecutive quads with the same texture form a run drawn
+// with one glDrawArrays, so sprites layer in the order they were drawn;
+// texture 0 means untextured. With the sprite atlas a whole frame is a
+// single draw call.
 
-    float offset = 0.023f;
-    if (left)
-        left->position.x -= offset;
-    if (right)
-        right->position.x += offset;
+struct Batch_Vertex
+{
+    float x, y;
+    float u, v;
+    uint8_t color[4];
+};
 
-    num_shots_fired += 1;
-}
+const int batch_run_max = 32;
 
-void invaders_simulate()
+struct Sprite_Batch
 {
-    double now = get_time();
+    int quad_count;
+    int quad_capacity;
+    Batch_Vertex *vertices;
 
-    double delta = now - last_time;
-    current_dt = (float)delta;
+    int run_count;
+    uint32_t run_texture[batch_run_max];
+    int run_first[batch_run_max];
+};
 
-    last_time = now;
+Sprite_Batch sprite_batch;
+Render_Stats render_stats;
 
-    while (1)
-    {
-        if (live_invader_count < num_desired_invaders)
-        {
-            add_invader();
-        }
+void batch_draw()
+{
+    Sprite_Batch *batch = &sprite_batch;
 
-        Event event;
-        bool received = get_next_event(&event);
-        if (!received)
-            break;
+    if (batch->quad_count > 0)
+    {
+        glEnableClientState(GL_VERTEX_ARRAY);
+        glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+        glEnableClientState(GL_COLOR_ARRAY);
 
-        if (event.type == EVENT_TYPE_QUIT)
-        {
-            should_quit_game = true;
-            return;
-        }
+        Batch_Vertex *v = batch->vertices;
+        glVertexPointer(2, GL_FLOAT, sizeof(Batch_Vertex), &v->x);
+        glTexCoordPointer(2, GL_FLOAT, sizeof(Batch_Vertex), &v->u);
+        glColorPointer(4, GL_UNSIGNED_BYTE, sizeof(Batch_Vertex), v->color);
 
-        if (event.type == EVENT_TYPE_KEYBOARD)
+        bool textured = true;
+        for (int r = 0; r < batch->run_count; r++)
         {
-            if (event.key_code == KEY_ARROW_LEFT)
-            {
-                key_left = event.key_pressed;
-            }
-            if (event.key_code == KEY_ARROW_RIGHT)
-            {
-                key_right = event.key_pressed;
-            }
-            if (event.key_code == KEY_ARROW_DOWN)
-            {
-                key_down = event.key_pressed;
-            }
-            if (event.key_code == KEY_ARROW_UP)
+            uint32_t texture = batch->run_texture[r];
+            if (texture == 0)
             {
-                key_up = event.key_pressed;
-            }
-            if (event.key_code == KEY_SHIFT)
-            {
-                if (event.key_pressed)
-                {
-                    do_fire_bullets();
-                }
+                glDisable(GL_TEXTURE_2D);
+                textured = false;
             }
-            if (event.key_code == KEY_ESCAPE)
+            else
             {
-                if (event.key_pressed)
+                if (!textured)
                 {
-                    should_quit_game = true;
+                    glEnable(GL_TEXTURE_2D);
+                    textured = true;
                 }
+                glBindTexture(GL_TEXTURE_2D, texture);
+                render_stats.texture_binds++;
             }
-        }
-    }
 
-    float dmove = 0.3f * current_dt;
-    float x0 = 0.01f;
-    float x1 = 0.99f;
-    float y0 = 0.02f;
-    float y1 = 0.15f;
+            int last = r + 1 < batch->run_count ? batch->run_first[r + 1] : batch->quad_count;
+            glDrawArrays(GL_TRIANGLES, 6 * batch->run_first[r], 6 * (last - batch->run_first[r]));
+            render_stats.draw_calls++;
+        }
+        if (!textured)
+        {
+            glEnable(GL_TEXTURE_2D);
+        }
 
-    if (key_left)
-    {
-        ship_position.x -= dmove;
-    }
-    if (key_right)
-    {
-        ship_position.x += dmove;
-    }
-    if (key_down)
-    {
-        ship_position.y -= dmove;
-    }
-    if (key_up)
-    {
-        ship_position.y += dmove;
+        glDisableClientState(GL_COLOR_ARRAY);
+        glDisableClientState(GL_TEXTURE_COORD_ARRAY);
+        glDisableClientState(GL_VERTEX_ARRAY);
     }
 
-    if (ship_position.x < x0)
-    {
-        ship_position.x = x0;
-    }
-    if (ship_position.x > x1)
-    {
-        ship_position.x = x1;
-    }
-    if (ship_position.y < y0)
-    {
-        ship_position.y = y0;
-    }
-    if (ship_position.y > y1)
-    {
-        ship_position.y = y1;
-    }
-    simulate_bullets();
-    simulate_invaders();
-    simulate_emitters();
-}
+    render_stats.quads += batch->quad_count;
 
-void init_gl_for_bitmap(Bitmap *bitmap)
-{
-    glGenTextures(1, &bitmap->id);
-    glBindTexture(GL_TEXTURE_2D, bitmap->id);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, bitmap->width, bitmap->height, 0, GL_RGBA, GL_UNSIGNED_BYTE, bitmap->data);
-    glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glBindTexture(GL_TEXTURE_2D, 0);
+    batch->quad_count = 0;
+    batch->run_count = 0;
 }
 
-void load_bitmap(const char *filename, Bitmap *result)
+Batch_Vertex *batch_quad(uint32_t texture)
 {
-    int width = 0;
-    int height = 0;
+    Sprite_Batch *batch = &sprite_batch;
 
-    uint8_t *data = stbi_load(filename, &width, &height, NULL, 0);
-    if (!data)
+    if (batch->run_count == 0 || batch->run_texture[batch->run_count - 1] != texture)
     {
-        return;
+        if (batch->run_count == batch_run_max)
+        {
+            batch_draw();
+        }
+        batch->run_texture[batch->run_count] = texture;
+        batch->run_first[batch->run_count] = batch->quad_count;
+        batch->run_count++;
     }
 
-    result->width = width;
-    result->height = height;
-    result->data = data;
+    if (batch->quad_count == batch->quad_capacity)
+    {
+        int capacity = batch->quad_capacity ? batch->quad_capacity * 2 : 1024;
+        batch->vertices = (Batch_Vertex *)realloc(batch->vertices, capacity * 6 * sizeof(Batch_Vertex));
+        batch->quad_capacity = capacity;
+    }
 
-    init_gl_for_bitmap(result);
+    return &batch->vertices[6 * batch->quad_count++];
 }
 
-void init_textures()
+void batch_flush()
 {
-    load_bitmap("ship.png", &ship_bitmap);
-    load_bitmap("bullet.png", &bullet_bitmap);
-    load_bitmap("contrail.png", &contrail_bitmap);
+    PROFILE_ZONE("batch_flush");
+
+    batch_draw();
+    render_stats.frames++;
+}
 
-    load_bitmap("bug1.png", &invader_bitmaps[0]);
-    load_bitmap("bug2.png", &invader_bitmaps[1]);
-    load_bitmap("bug3.png", &invader_bitmaps[2]);
-    load_bitmap("bug4.png", &invader_bitmaps[3]);
+void set_vertex(Batch_Vertex *v, Vector2 p, float u, float t, Vector4 color)
+{
+    v->x = p.x;
+    v->y = p.y;
+    v->u = u;
+    v->v = t;
+    v->color[0] = (uint8_t)(color.x * 255.0f + 0.5f);
+    v->color[1] = (uint8_t)(color.y * 255.0f + 0.5f);
+    v->color[2] = (uint8_t)(color.z * 255.0f + 0.5f);
+    v->color[3] = (uint8_t)(color.w * 255.0f + 0.5f);
 }
 
 void draw_gradient()
 {
-    glDisable(GL_TEXTURE_2D);
+    PROFILE_ZONE("draw_gradient");
 
     Vector2 p0 = make_vector2(0, 0);
     Vector2 p1 = make_vector2(1, 0);
@@ -752,46 +3100,32 @@ void draw_gradient()
     g1 *= k1;
     b1 *= k1;
 
-    float z = 0;
-
-    glBegin(GL_TRIANGLES);
-
-    glColor3f(r0, g0, b0);
-    glVertex3f(p0.x, p0.y, z);
-    glColor3f(r0, g0, b0);
-    glVertex3f(p1.x, p1.y, z);
-    glColor3f(r1, g1, b1);
-    glVertex3f(p2.x, p2.y, z);
+    Vector4 c0 = make_vector4(r0, g0, b0, 1);
+    Vector4 c1 = make_vector4(r1, g1, b1, 1);
 
-    glColor3f(r0, g0, b0);
-    glVertex3f(p0.x, p0.y, z);
-    glColor3f(r1, g1, b1);
-    glVertex3f(p2.x, p2.y, z);
-    glColor3f(r1, g1, b1);
-    glVertex3f(p3.x, p3.y, z);
+    Bitmap *white = &white_bitmap;
+    Batch_Vertex *v = batch_quad(white->id);
 
-    glEnd();
+    set_vertex(&v[0], p0, white->u0, white->v0, c0);
+    set_vertex(&v[1], p1, white->u0, white->v0, c0);
+    set_vertex(&v[2], p2, white->u0, white->v0, c1);
 
-    glEnable(GL_TEXTURE_2D);
+    set_vertex(&v[3], p0, white->u0, white->v0, c0);
+    set_vertex(&v[4], p2, white->u0, white->v0, c1);
+    set_vertex(&v[5], p3, white->u0, white->v0, c1);
 }
 
-void draw_quad(Vector2 p0, Vector2 p1, Vector2 p2, Vector2 p3)
+void draw_quad(Bitmap *bitmap, Vector2 p0, Vector2 p1, Vector2 p2, Vector2 p3, Vector4 color)
 {
-    float z = 0;
+    Batch_Vertex *v = batch_quad(bitmap->id);
 
-    glTexCoord2f(0, 1);
-    glVertex3f(p0.x, p0.y, z);
-    glTexCoord2f(1, 1);
-    glVertex3f(p1.x, p1.y, z);
-    glTexCoord2f(1, 0);
-    glVertex3f(p2.x, p2.y, z);
+    set_vertex(&v[0], p0, bitmap->u0, bitmap->v1, color);
+    set_vertex(&v[1], p1, bitmap->u1, bitmap->v1, color);
+    set_vertex(&v[2], p2, bitmap->u1, bitmap->v0, color);
 
-    glTexCoord2f(0, 1);
-    glVertex3f(p0.x, p0.y, z);
-    glTexCoord2f(1, 0);
-    glVertex3f(p2.x, p2.y, z);
-    glTexCoord2f(0, 0);
-    glVertex3f(p3.x, p3.y, z);
+    set_vertex(&v[3], p0, bitmap->u0, bitmap->v1, color);
+    set_vertex(&v[4], p2, bitmap->u1, bitmap->v0, color);
+    set_vertex(&v[5], p3, bitmap->u0, bitmap->v0, color);
 }
 
 Vector2 moved_vector2(float x, float y, float ox, float oy, float scale, Vector2 position)
@@ -812,7 +3146,7 @@ Vector2 moved_vector2(float x, float y, float ox, float oy, float scale, Vector2
     return result;
 }
 
-void draw_quad_centered_at(Vector2 position, float radius)
+void draw_quad_centered_at(Bitmap *bitmap, Vector2 position, float radius, Vector4 color)
 {
     Vector2 p0 = position;
     Vector2 p1 = position;
@@ -832,25 +3166,23 @@ void draw_quad_centered_at(Vector2 position, float radius)
     p3.x -= b;
     p3.y += b;
 
-    draw_quad(p0, p1, p2, p3);
+    draw_quad(bitmap, p0, p1, p2, p3, color);
 }
 
-void draw_emitter(Particle_Emitter *emitter)
+void draw_particles()
 {
-    glBindTexture(GL_TEXTURE_2D, contrail_bitmap.id);
-
-    glBegin(GL_TRIANGLES);
+    PROFILE_ZONE("draw_particles");
 
-    for (int i = 0; i < emitter->particle_count; i++)
+    Particle_Pool *p = &world->particle_pool;
+    for (int i = 0; i < p->count; i++)
     {
-        Particle *p = &emitter->particles[i];
-
+        float fadeout_period = world->emitters[p->emitter[i]].fadeout_period;
         float alpha = 1.0f;
 
-        float tail_time = p->lifetime - p->elapsed;
-        if (tail_time < emitter->fadeout_period)
+        float tail_time = p->lifetime[i] - p->elapsed[i];
+        if (tail_time < fadeout_period)
         {
-            float t = tail_time / emitter->fadeout_period;
+            float t = tail_time / fadeout_period;
             if (t < 0)
                 t = 0;
             if (t > 1)
@@ -858,103 +3190,469 @@ void draw_emitter(Particle_Emitter *emitter)
             alpha = t;
         }
 
-        Vector4 c = p->color;
-        glColor4f(c.x, c.y, c.z, c.w * alpha);
-        draw_quad_centered_at(p->position, p->size);
-    }
+        // Particles keep no previous position; step back along the velocity
+        // to the same point in time as the interpolated sprites.
+        float back = (1.0f - render_alpha) * tick_dt;
+        Vector2 position;
+        position.x = p->position_x[i] - p->velocity_x[i] * back;
+        position.y = p->position_y[i] - p->velocity_y[i] * back;
 
-    glEnd();
+        Vector4 c = p->color[i];
+        c.w *= alpha;
+        draw_quad_centered_at(&contrail_bitmap, position, p->size[i], c);
+    }
 }
 
 void draw_bullet(Bullet *bullet)
 {
-    Vector2 position = bullet->position;
+    PROFILE_ZONE("draw_bullet");
+
+    Vector2 position = lerp(bullet->previous_position, bullet->position, render_alpha);
     float bullet_size = 0.02f;
 
-    glBindTexture(GL_TEXTURE_2D, bullet_bitmap.id);
-    glBegin(GL_TRIANGLES);
-    glColor4f(1, 1, 1, 1);
-    draw_quad_centered_at(position, bullet_size);
-    glEnd();
+    draw_quad_centered_at(&bullet_bitmap, position, bullet_size, make_vector4(1, 1, 1, 1));
+}
+
+void draw_projectiles()
+{
+    PROFILE_ZONE("draw_projectiles");
+
+    // Like particles, projectiles step back along their velocity instead of
+    // keeping a previous position.
+    Projectile_Pool *p = &world->projectiles;
+    float back = (1.0f - render_alpha) * tick_dt;
+    float projectile_size = 0.012f;
+    Vector4 color = make_vector4(1, 0.45f, 0.3f, 1);
+    for (int i = 0; i < p->count; i++)
+    {
+        Vector2 position;
+        position.x = p->position_x[i] - p->velocity_x[i] * back;
+        position.y = p->position_y[i] - p->velocity_y[i] * back;
+        draw_quad_centered_at(&bullet_bitmap, position, projectile_size, color);
+    }
 }
 
 void draw_ship()
 {
+    PROFILE_ZONE("draw_ship");
+
     float ship_size = 0.04f;
-    glBindTexture(GL_TEXTURE_2D, ship_bitmap.id);
-    glBegin(GL_TRIANGLES);
-    glColor4f(1, 1, 1, 1);
-    draw_quad_centered_at(ship_position, ship_size);
-    glEnd();
+    draw_quad_centered_at(&ship_bitmap, lerp(world->ship_previous_position, world->ship_position, render_alpha), ship_size, make_vector4(1, 1, 1, 1));
 }
 
 void draw_invader(Invader *invader)
 {
+    PROFILE_ZONE("draw_invader");
+
     float invader_size = 0.03f;
-    glBindTexture(GL_TEXTURE_2D, invader->bitmap->id);
-    glBegin(GL_TRIANGLES);
-    glColor4f(1, 1, 1, 1);
-    draw_quad_centered_at(invader->position, invader_size);
-    glEnd();
+    draw_quad_centered_at(invader->bitmap, lerp(invader->previous_position, invader->position, render_alpha), invader_size, make_vector4(1, 1, 1, 1));
 }
 
-int invaders()
+void invaders_init()
 {
     last_time = get_time();
+    double start = last_time;
 
     int width = 800;
     int height = 600;
 
+    int32_t seed = default_random_seed;
+    begin_input_log(&seed);
+
+    jobs_init(job_thread_count);
     create_window(width, height);
     init_textures();
+    alloc_world(world, particle_pool_max, projectile_pool_max);
+    reset_world(seed);
 
-    for (int i = 0; i < num_desired_invaders; i++)
-    {
-        add_invader();
-    }
-
+    glEnable(GL_TEXTURE_2D);
     glEnable(GL_BLEND);
     glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
     double aspect = (double)height / (double)width;
     glOrtho(0, 1, 0, aspect, -1, 1);
 
-    ship_position.x = 0.5f;
-    ship_position.y = 0.1f;
+    if (start_snapshot && !load_snapshot(start_snapshot, start_snapshot_size))
+    {
+        fprintf(stderr, "Snapshot does not match this build\n");
+        should_quit_game = true;
+    }
+
+    startup_stats.total = get_time() - start;
+}
+
+int invaders()
+{
+    invaders_init();
+    hot_reload = watch_directory(".");
 
     while (1)
     {
         if (should_quit_game)
         {
-            return num_invaders_destroyed;
+            stop_sprite_reloads();
+            end_input_log();
+            profile_trace_stop();
+            jobs_shutdown();
+            return world->num_invaders_destroyed;
+        }
+
+        update_sprite_reloads();
+
+        invaders_simulate();
+        if (should_quit_game)
+        {
+            continue;
         }
 
         float k = 0.05f;
-        window_clear(k, k, k, 1);
+        {
+            PROFILE_ZONE("window_clear");
+            window_clear(k, k, k, 1);
+        }
 
         draw_gradient();
 
-        invaders_simulate();
-
         draw_ship();
 
-        for (int i = 0; i < bullet_count; i++)
+        for (int i = 0; i < world->bullet_count; i++)
+        {
+            draw_bullet(&world->bullets[i]);
+        }
+        for (int i = 0; i < world->live_invader_count; i++)
+        {
+            draw_invader(&world->live_invaders[i]);
+        }
+        draw_projectiles();
+        draw_particles();
+
+        batch_flush();
+
         {
-            draw_bullet(&bullets[i]);
+            PROFILE_ZONE("swap_buffers");
+            swap_buffers();
         }
-        for (int i = 0; i < live_invader_count; i++)
         {
-            draw_invader(&live_invaders[i]);
+            PROFILE_ZONE("do_sleep");
+            do_sleep(5);
         }
-        for (int i = 0; i < live_emitter_count; i++)
         {
-            draw_emitter(&emitters[i]);
+            PROFILE_ZONE("update_window_events");
+            if (update_window_events())
+            {
+                should_quit_game = true;
+            }
         }
 
-        swap_buffers();
+        PROFILE_END_FRAME();
+    }
+}
+
+Uncapped_Result invaders_uncapped(int tick_limit, float dt)
+{
+    fixed_dt = dt;
+    tick_dt = dt;
+
+    invaders_init();
+
+    Uncapped_Result result = {};
+    double start = get_time();
 
-        do_sleep(5);
+    while (!should_quit_game && (tick_limit < 0 || result.ticks < tick_limit))
+    {
+        result.ticks += invaders_simulate();
 
         update_window_events();
+
+        PROFILE_END_FRAME();
+    }
+
+    result.seconds = get_time() - start;
+    result.invaders_destroyed = world->num_invaders_destroyed;
+
+    end_input_log();
+    profile_trace_stop();
+    jobs_shutdown();
+    return result;
+}
+
+Stress_Result run_stress_scenario(const Stress_Scenario *scenario, int ticks)
+{
+    int saved_bullet_max = bullet_max;
+    int saved_live_invader_max = live_invader_max;
+    int saved_emitter_max = emitter_max;
+    int saved_num_desired_invaders = num_desired_invaders;
+    float saved_auto_fire_rate = auto_fire_rate;
+    int saved_emitters_per_explosion = emitters_per_explosion;
+
+    // Bullets fly for at most 2.5 s and their trails last another second;
+    // explosions last 1.3 s. Invaders fire at most every 1.5 s, and their
+    // projectiles cross the playfield in under 4 s.
+    float rate = scenario->fire_rate > 0 ? scenario->fire_rate : 0;
+    int epe = scenario->emitters_per_explosion > 0 ? scenario->emitters_per_explosion : 0;
+    double emitters = 2 * rate * 3.5 + 2 * rate * 1.3 * epe + 3.0 * scenario->invaders + 64;
+    int particles = (int)(emitters < (1 << 21) / 128 ? emitters * 128 : 1 << 21);
+    int projectiles = scenario->invaders < (1 << 24) / 3 ? 3 * scenario->invaders : 1 << 24;
+    // Every bullet takes a trail emitter, so bullets are capped the same way.
+    double bullets = 2 * rate * 2.5 + 2;
+
+    bullet_max = bullets < emitter_capacity_limit ? (int)bullets : emitter_capacity_limit;
+    live_invader_max = scenario->invaders;
+    emitter_max = emitters < emitter_capacity_limit ? (int)emitters : emitter_capacity_limit;
+    num_desired_invaders = scenario->invaders;
+    auto_fire_rate = rate;
+    emitters_per_explosion = epe;
+
+    jobs_init(job_thread_count);
+    World *previous = world;
+    world = (World *)calloc(1, sizeof(World));
+    alloc_world(world, particles > particle_pool_max ? particles : particle_pool_max,
+                projectiles > projectile_pool_max ? projectiles : projectile_pool_max);
+    reset_world(default_random_seed);
+    world->key_right = 1;
+
+    Stress_Result result = {};
+    phase_seconds = result.phase_seconds;
+
+    for (int i = 0; i < ticks; i++)
+    {
+        if (world->ship_position.x > 0.95f)
+        {
+            world->key_left = 1;
+            world->key_right = 0;
+        }
+        if (world->ship_position.x < 0.05f)
+        {
+            world->key_left = 0;
+            world->key_right = 1;
+        }
+
+        double start = get_time();
+        save_previous_positions();
+        simulate_tick(tick_dt);
+        result.seconds += get_time() - start;
+        result.ticks++;
+
+        result.bullets += world->bullet_count;
+        result.invaders += world->live_invader_count;
+        result.projectiles += world->projectiles.count;
+        result.emitters += world->live_emitter_count;
+        result.particles += world->particle_pool.count;
+    }
+
+    if (result.ticks > 0)
+    {
+        result.bullets /= result.ticks;
+        result.invaders /= result.ticks;
+        result.projectiles /= result.ticks;
+        result.emitters /= result.ticks;
+        result.particles /= result.ticks;
+    }
+
+    phase_seconds = NULL;
+    free_world(world);
+    free(world);
+    world = previous;
+
+    bullet_max = saved_bullet_max;
+    live_invader_max = saved_live_invader_max;
+    emitter_max = saved_emitter_max;
+    num_desired_invaders = saved_num_desired_invaders;
+    auto_fire_rate = saved_auto_fire_rate;
+    emitters_per_explosion = saved_emitters_per_explosion;
+    return result;
+}
+
+Render_Stats get_render_stats()
+{
+    return render_stats;
+}
+
+Startup_Stats get_startup_stats()
+{
+    return startup_stats;
+}
+
+uint32_t hash_bytes(uint32_t hash, const void *data, size_t size)
+{
+    const uint8_t *bytes = (const uint8_t *)data;
+    for (size_t i = 0; i < size; i++)
+    {
+        hash = (hash ^ bytes[i]) * 16777619u;
+    }
+    return hash;
+}
+
+uint32_t get_state_hash()
+{
+    uint32_t hash = 2166136261u;
+    hash = hash_bytes(hash, &world->tick, sizeof(world->tick));
+    hash = hash_bytes(hash, &world->next_entity_id, sizeof(world->next_entity_id));
+    hash = hash_bytes(hash, &world->ship_position, sizeof(world->ship_position));
+    hash = hash_bytes(hash, &world->num_invaders_destroyed, sizeof(world->num_invaders_destroyed));
+    hash = hash_bytes(hash, &world->num_ship_hits, sizeof(world->num_ship_hits));
+
+    for (int i = 0; i < world->bullet_count; i++)
+    {
+        hash = hash_bytes(hash, &world->bullets[i].position, sizeof(Vector2));
+    }
+    for (int i = 0; i < world->live_invader_count; i++)
+    {
+        hash = hash_bytes(hash, &world->live_invaders[i].position, sizeof(Vector2));
+        hash = hash_bytes(hash, &world->live_invaders[i].target_position, sizeof(Vector2));
+    }
+
+    Particle_Pool *p = &world->particle_pool;
+    hash = hash_bytes(hash, &p->count, sizeof(p->count));
+    hash = hash_bytes(hash, p->position_x, p->count * sizeof(float));
+    hash = hash_bytes(hash, p->position_y, p->count * sizeof(float));
+
+    Projectile_Pool *projectiles = &world->projectiles;
+    hash = hash_bytes(hash, &projectiles->count, sizeof(projectiles->count));
+    hash = hash_bytes(hash, projectiles->position_x, projectiles->count * sizeof(float));
+    hash = hash_bytes(hash, projectiles->position_y, projectiles->count * sizeof(float));
+    return hash;
+}
+
+// Env batch. Each game owns a World; a step runs the games through
+// parallel_for, pointing the thread's current world at each game of a chunk
+// in turn and running one tick there.
+
+struct Env_Batch
+{
+    int count;
+    World *worlds;
+    int *episodes;
+    int *ticks;
+    bool *done;
+
+    uint32_t seed;
+    int episode_ticks;
+
+    const Env_Action *actions;
+    Env_Result *results;
+};
+
+// Plenty for a game played at the normal fire rate.
+const int env_projectile_max = 1024;
+
+uint64_t mix_bits(uint64_t x)
+{
+    x += 0x9e3779b97f4a7c15ull;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+    return x ^ (x >> 31);
+}
+
+int32_t env_seed(Env_Batch *batch, int index, int episode)
+{
+    uint64_t x = mix_bits(mix_bits(mix_bits(batch->seed) ^ (uint64_t)index) ^ (uint64_t)episode);
+    return (int32_t)(uint32_t)x;
+}
+
+void env_reset_game(Env_Batch *batch, int index)
+{
+    World *previous = world;
+    world = &batch->worlds[index];
+    reset_world(env_seed(batch, index, batch->episodes[index]));
+    world = previous;
+
+    batch->ticks[index] = 0;
+    batch->done[index] = false;
+}
+
+void env_step_games(void *context, int first, int end)
+{
+    Env_Batch *batch = (Env_Batch *)context;
+
+    World *previous = world;
+    for (int i = first; i < end; i++)
+    {
+        if (batch->done[i])
+        {
+            batch->episodes[i]++;
+            env_reset_game(batch, i);
+        }
+
+        world = &batch->worlds[i];
+
+        const Env_Action *action = &batch->actions[i];
+        world->key_left = action->left;
+        world->key_right = action->right;
+        world->key_up = action->up;
+        world->key_down = action->down;
+
+        int destroyed = world->num_invaders_destroyed;
+        if (action->fire)
+        {
+            do_fire_bullets();
+        }
+
+        save_previous_positions();
+        simulate_tick(tick_dt);
+
+        batch->ticks[i]++;
+        batch->done[i] = batch->ticks[i] >= batch->episode_ticks;
+
+        Env_Result *result = &batch->results[i];
+        result->ship_x = world->ship_position.x;
+        result->ship_y = world->ship_position.y;
+        result->reward = world->num_invaders_destroyed - destroyed;
+        result->episode_ticks = batch->ticks[i];
+        result->done = batch->done[i];
+    }
+    world = previous;
+}
+
+Env_Batch *env_batch_create(int count, uint32_t seed, int episode_ticks, int particle_capacity)
+{
+    jobs_init(job_thread_count);
+
+    Env_Batch *batch = (Env_Batch *)calloc(1, sizeof(Env_Batch));
+    batch->count = count;
+    batch->worlds = (World *)calloc(count, sizeof(World));
+    batch->episodes = (int *)calloc(count, sizeof(int));
+    batch->ticks = (int *)calloc(count, sizeof(int));
+    batch->done = (bool *)calloc(count, sizeof(bool));
+    batch->seed = seed;
+    batch->episode_ticks = episode_ticks;
+
+    for (int i = 0; i < count; i++)
+    {
+        alloc_world(&batch->worlds[i], particle_capacity, env_projectile_max);
+    }
+    env_batch_reset(batch);
+    return batch;
+}
+
+void env_batch_destroy(Env_Batch *batch)
+{
+    for (int i = 0; i < batch->count; i++)
+    {
+        free_world(&batch->worlds[i]);
+    }
+    free(batch->worlds);
+    free(batch->episodes);
+    free(batch->ticks);
+    free(batch->done);
+    free(batch);
+}
+
+void env_batch_reset(Env_Batch *batch)
+{
+    for (int i = 0; i < batch->count; i++)
+    {
+        batch->episodes[i] = 0;
+        env_reset_game(batch, i);
     }
 }
+
+void env_batch_step(Env_Batch *batch, const Env_Action *actions, Env_Result *results)
+{
+    batch->actions = actions;
+    batch->results = results;
+
+    // A few chunks per thread so stealing can even out uneven games.
+    int grain = batch->count / (jobs_thread_count() * 4);
+    parallel_for(batch->count, grain, env_step_games, batch);
+}
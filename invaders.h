@@ -1,5 +1,8 @@
 #pragma once
 
+#include <stddef.h>
+#include <stdint.h>
+
 enum EventType
 {
     EVENT_TYPE_NONE,
@@ -16,6 +19,7 @@ enum KeyCode
     KEY_ARROW_UP,
     KEY_SHIFT,
     KEY_ESCAPE,
+    KEY_F1,
 };
 
 struct Event
@@ -23,16 +27,164 @@ struct Event
     EventType type;
     KeyCode key_code;
     bool key_pressed;
+    double time; // get_time() when the platform saw the event
 };
 
 // Platform functions
 bool create_window(int width, int height);
 void window_clear(float r, float g, float b, float a);
 void swap_buffers();
-bool update_window_events();
+bool update_window_events(); // true when the platform asks the game to stop
 void do_sleep(int ms);
 double get_time();
 bool get_next_event(Event *event);
 
+// Maps a whole file copy-on-write: its pages are shared with the file, and
+// with other processes mapping it, until written. Returns NULL if the file
+// cannot be mapped.
+void *map_file(const char *filename, size_t *size);
+void unmap_file(void *data, size_t size);
+
+// Watches a directory for files that are written or moved into it. Each
+// call to next_changed_file returns one such file name, without the
+// directory, or false once none are pending; it never blocks.
+bool watch_directory(const char *directory);
+bool next_changed_file(char *name, size_t capacity);
+
+// Tunables the platform layer may set before calling invaders()
+extern int particle_pool_max;
+extern int projectile_pool_max; // live invader projectiles the game can hold
+extern int job_thread_count; // threads for the job pool; 0 uses every core
+extern int bullet_max;
+extern int live_invader_max;
+extern int emitter_max; // at most 32767
+extern int num_desired_invaders; // invaders kept alive
+extern float auto_fire_rate; // volleys per second fired without input
+extern int emitters_per_explosion;
+
+struct Uncapped_Result
+{
+    int ticks;
+    double seconds;
+    int invaders_destroyed;
+};
+
+// Totals since startup; divide by frames for per-frame figures.
+struct Render_Stats
+{
+    int frames;
+    int64_t draw_calls;
+    int64_t texture_binds;
+    int64_t quads;
+};
+
+Render_Stats get_render_stats();
+
+// Wall-clock seconds from entering invaders() to the first frame.
+struct Startup_Stats
+{
+    double total;
+    double assets; // mapping the asset pack, or decoding and packing the images
+    double upload; // texture uploads
+    bool from_pack;
+};
+
+Startup_Stats get_startup_stats();
+
+// Hash of the simulation state, for checking that two runs match.
+uint32_t get_state_hash();
+
+// Input recording and replay; call before invaders() or invaders_uncapped().
+// A recording holds the RNG seed and settings plus each frame's time delta
+// and input events, so playing it back reproduces the session exactly.
+bool invaders_start_recording(const char *filename);
+bool invaders_start_playback(const char *filename);
+
+// World snapshots: only live entities are stored and pointers become
+// indices. save_snapshot returns the bytes written, or 0 if capacity is
+// smaller than snapshot_size(). load_snapshot leaves the world untouched and
+// returns false if the data is not a valid snapshot for this build.
+size_t snapshot_size();
+size_t save_snapshot(void *buffer, size_t capacity);
+bool load_snapshot(const void *data, size_t size);
+
+// Starts the next game from a snapshot instead of a fresh world. The data
+// must stay valid until invaders() or invaders_uncapped() has started.
+void invaders_start_from_snapshot(const void *data, size_t size);
+
 // game entry point
 int invaders();
+
+// Batch simulation: many independent games, each in its own world, stepped
+// in lockstep without drawing. Every step advances each game by one tick of
+// 1/120 s. Games are spread over the job pool (see job_thread_count).
+struct Env_Batch;
+
+struct Env_Action
+{
+    uint8_t left;
+    uint8_t right;
+    uint8_t up;
+    uint8_t down;
+    uint8_t fire; // fires a volley this step
+};
+
+struct Env_Result
+{
+    float ship_x;
+    float ship_y;
+    int reward;  // invaders destroyed this step
+    int episode_ticks;
+    bool done;   // episode reached its length; the game restarts next step
+};
+
+// Games run episode_ticks ticks per episode. Each episode gets its own seed,
+// derived from seed, the game's index and the episode number.
+Env_Batch *env_batch_create(int count, uint32_t seed, int episode_ticks, int particle_capacity);
+void env_batch_destroy(Env_Batch *batch);
+void env_batch_reset(Env_Batch *batch);
+void env_batch_step(Env_Batch *batch, const Env_Action *actions, Env_Result *results);
+
+// The phases of a simulation tick, in the order they run.
+enum Sim_Phase
+{
+    PHASE_BULLETS,
+    PHASE_INVADERS,
+    PHASE_PROJECTILES,
+    PHASE_EMITTERS,
+    PHASE_COUNT,
+};
+
+// Stress scenarios: the simulation alone, without drawing or input, in a
+// world sized so nothing the scenario asks for is turned away. The ship
+// sweeps from side to side, firing volleys at fire_rate.
+struct Stress_Scenario
+{
+    int invaders;
+    float fire_rate; // volleys per second
+    int emitters_per_explosion;
+};
+
+struct Stress_Result
+{
+    int ticks;
+    double seconds;
+    double phase_seconds[PHASE_COUNT];
+
+    // Mean live entities per tick.
+    double bullets;
+    double invaders;
+    double projectiles;
+    double emitters;
+    double particles;
+};
+
+// Runs ticks ticks of the scenario from a fresh game on the current
+// settings, which it leaves as they were.
+Stress_Result run_stress_scenario(const Stress_Scenario *scenario, int ticks);
+
+// Runs the simulation back to back with a fixed timestep, without drawing
+// or sleeping, until tick_limit ticks have run (-1 for no limit) or the game
+// quits. A replayed frame can run several ticks, so a replay may overshoot
+// the limit by up to one frame's ticks.
+Uncapped_Result invaders_uncapped(int tick_limit, float dt);
@@ -0,0 +1,256 @@
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include "jobs.h"
+#include "profiler.h"
+
+struct Job_Group
+{
+    std::atomic<int> pending;
+};
+
+struct Job
+{
+    Job_Function *body;
+    void *context;
+    int first;
+    int end;
+    Job_Group *group;
+};
+
+// A bounded deque behind a lock. Its owner pushes and pops at the back, so
+// it works through its most recent (cache-warm) chunks first; thieves take
+// the oldest chunks from the front. Chunks are coarse, so the lock is cheap
+// next to the work.
+const int job_queue_max = 1024;
+
+struct Job_Queue
+{
+    std::mutex mutex;
+    Job jobs[job_queue_max];
+    int front;
+    int count;
+};
+
+struct Job_Pool
+{
+    int thread_count;
+
+    // One queue per pool thread. Threads outside the pool share queue 0.
+    Job_Queue *queues;
+    std::thread *threads;
+
+    std::mutex sleep_mutex;
+    std::condition_variable wake;
+    std::atomic<int> queued;
+    std::atomic<bool> quitting;
+};
+
+Job_Pool *job_pool = NULL;
+thread_local int job_thread_index = 0;
+
+// How many times an idle worker looks for work before it sleeps.
+const int job_spin_count = 256;
+
+bool push_job(Job_Queue *queue, Job job)
+{
+    std::lock_guard<std::mutex> lock(queue->mutex);
+    if (queue->count == job_queue_max)
+        return false;
+
+    queue->jobs[(queue->front + queue->count) % job_queue_max] = job;
+    queue->count++;
+    return true;
+}
+
+bool pop_job(Job_Queue *queue, Job *job)
+{
+    std::lock_guard<std::mutex> lock(queue->mutex);
+    if (queue->count == 0)
+        return false;
+
+    queue->count--;
+    *job = queue->jobs[(queue->front + queue->count) % job_queue_max];
+    return true;
+}
+
+bool steal_job(Job_Queue *queue, Job *job)
+{
+    std::lock_guard<std::mutex> lock(queue->mutex);
+    if (queue->count == 0)
+        return false;
+
+    *job = queue->jobs[queue->front];
+    queue->front = (queue->front + 1) % job_queue_max;
+    queue->count--;
+    return true;
+}
+
+bool find_job(Job_Pool *pool, Job *job)
+{
+    if (pool->queued.load(std::memory_order_relaxed) == 0)
+        return false;
+
+    int self = job_thread_index;
+    bool found = pop_job(&pool->queues[self], job);
+    for (int k = 1; !found && k < pool->thread_count; k++)
+    {
+        found = steal_job(&pool->queues[(self + k) % pool->thread_count], job);
+    }
+
+    if (found)
+    {
+        pool->queued.fetch_sub(1, std::memory_order_relaxed);
+    }
+    return found;
+}
+
+void run_job(Job *job)
+{
+    job->body(job->context, job->first, job->end);
+    job->group->pending.fetch_sub(1, std::memory_order_release);
+}
+
+void job_worker(Job_Pool *pool, int index)
+{
+    job_thread_index = index;
+    profile_ignore_thread();
+
+    int idle = 0;
+    while (!pool->quitting.load(std::memory_order_relaxed))
+    {
+        Job job;
+        if (find_job(pool, &job))
+        {
+            run_job(&job);
+            idle = 0;
+            continue;
+        }
+
+        if (++idle < job_spin_count)
+        {
+            std::this_thread::yield();
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(pool->sleep_mutex);
+        pool->wake.wait(lock, [pool] { return pool->queued.load() > 0 || pool->quitting.load(); });
+        idle = 0;
+    }
+}
+
+void jobs_init(int thread_count)
+{
+    if (job_pool)
+        return;
+
+    if (thread_count <= 0)
+    {
+        thread_count = (int)std::thread::hardware_concurrency();
+    }
+    if (thread_count < 1)
+    {
+        thread_count = 1;
+    }
+
+    Job_Pool *pool = new Job_Pool();
+    pool->thread_count = thread_count;
+    pool->queues = new Job_Queue[thread_count]();
+    pool->threads = new std::thread[thread_count];
+    pool->queued = 0;
+    pool->quitting = false;
+
+    for (int i = 1; i < thread_count; i++)
+    {
+        pool->threads[i] = std::thread(job_worker, pool, i);
+    }
+    job_pool = pool;
+}
+
+void jobs_shutdown()
+{
+    Job_Pool *pool = job_pool;
+    if (!pool)
+        return;
+
+    {
+        std::lock_guard<std::mutex> lock(pool->sleep_mutex);
+        pool->quitting = true;
+    }
+    pool->wake.notify_all();
+    for (int i = 1; i < pool->thread_count; i++)
+    {
+        pool->threads[i].join();
+    }
+
+    delete[] pool->threads;
+    delete[] pool->queues;
+    delete pool;
+    job_pool = NULL;
+}
+
+int jobs_thread_count()
+{
+    return job_pool ? job_pool->thread_count : 1;
+}
+
+void parallel_for(int count, int grain, Job_Function *body, void *context)
+{
+    if (count <= 0)
+        return;
+    if (grain < 1)
+        grain = 1;
+
+    Job_Pool *pool = job_pool;
+    if (!pool || pool->thread_count == 1 || count <= grain)
+    {
+        body(context, 0, count);
+        return;
+    }
+
+    Job_Group group;
+    group.pending = (count + grain - 1) / grain;
+
+    Job_Queue *queue = &pool->queues[job_thread_index];
+    int queued = 0;
+    for (int first = 0; first < count; first += grain)
+    {
+        Job job;
+        job.body = body;
+        job.context = context;
+        job.first = first;
+        job.end = first + grain < count ? first + grain : count;
+        job.group = &group;
+
+        // A full queue means plenty of work already; do this chunk now.
+        if (push_job(queue, job))
+        {
+            queued++;
+        }
+        else
+        {
+            run_job(&job);
+        }
+    }
+
+    if (queued > 0)
+    {
+        pool->queued.fetch_add(queued);
+        std::lock_guard<std::mutex> lock(pool->sleep_mutex);
+        pool->wake.notify_all();
+    }
+
+    while (group.pending.load(std::memory_order_acquire) > 0)
+    {
+        Job job;
+        if (find_job(pool, &job))
+        {
+            run_job(&job);
+        }
+        else
+        {
+            std::this_thread::yield();
+        }
+    }
+}
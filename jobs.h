@@ -0,0 +1,21 @@
+#pragma once
+
+// Work-stealing thread pool. parallel_for splits a range into chunks and
+// queues them on the calling thread's deque; idle threads steal from the
+// other end of any deque, and the caller works through its own chunks until
+// every one has finished. Calls may nest: a thread waiting on a range keeps
+// running other queued chunks.
+
+// Starts thread_count - 1 worker threads (0 means one per core). Does
+// nothing if the pool is already running.
+void jobs_init(int thread_count);
+void jobs_shutdown();
+
+// Threads that run chunks, the calling thread included; 1 before jobs_init.
+int jobs_thread_count();
+
+// Calls body(context, first, end) over [0, count) in chunks of at most grain
+// items and returns once all of them are done. Ranges of one chunk, and all
+// ranges before jobs_init, run inline on the calling thread.
+typedef void Job_Function(void *context, int first, int end);
+void parallel_for(int count, int grain, Job_Function *body, void *context);
@@ -0,0 +1,755 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <sys/inotify.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <thread>
+#include <GL/gl.h>
+#include "invaders.h"
+#include "event-queue.h"
+#include "headless-gl.h"
+#include "profiler.h"
+#include "jobs.h"
+
+// Headless Linux platform layer. There is no window and no GL context: the
+// GL entry points used by the game are provided by headless-gl.cpp, which
+// either ignores them or rasterizes into a memory framebuffer, and input
+// comes from an optional event script instead of a keyboard.
+//
+// Event script format, one event per line ('#' starts a comment):
+//
+//     <frame> <left|right|up|down|shift|escape|f1> <down|up>
+//     <frame> quit
+//
+// Events are delivered at the end of the given frame, in file order.
+//
+// With --stdin, an input thread reads the same lines without the frame
+// number from standard input and queues each one as soon as it arrives.
+
+struct Script_Event
+{
+    int frame;
+    Event event;
+};
+
+Script_Event *script_events = NULL;
+int script_event_count = 0;
+int script_event_next = 0;
+
+int frame_index = 0;
+int frame_limit = -1;
+
+bool software_render = false;
+
+// platform services to game code
+
+bool create_window(int width, int height)
+{
+    if (software_render)
+    {
+        software_render_init(width, height);
+    }
+    return true;
+}
+
+void window_clear(float r, float g, float b, float a)
+{
+    glClearColor(r, g, b, a);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+}
+
+void swap_buffers()
+{
+    software_render_end_frame();
+}
+
+void do_sleep(int ms)
+{
+    struct timespec ts;
+    ts.tv_sec = ms / 1000;
+    ts.tv_nsec = (long)(ms % 1000) * 1000000;
+    nanosleep(&ts, NULL);
+}
+
+double get_time()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+void *map_file(const char *filename, size_t *size)
+{
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0)
+        return NULL;
+
+    struct stat info;
+    void *data = MAP_FAILED;
+    if (fstat(fd, &info) == 0 && info.st_size > 0)
+    {
+        data = mmap(NULL, (size_t)info.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    }
+    close(fd);
+
+    if (data == MAP_FAILED)
+        return NULL;
+    *size = (size_t)info.st_size;
+    return data;
+}
+
+void unmap_file(void *data, size_t size)
+{
+    munmap(data, size);
+}
+
+int watch_fd = -1;
+
+// Events read from watch_fd but not returned yet.
+alignas(struct inotify_event) char watch_buffer[4096];
+int watch_buffer_length = 0;
+int watch_buffer_at = 0;
+
+bool watch_directory(const char *directory)
+{
+    watch_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (watch_fd < 0)
+        return false;
+
+    // Editors either rewrite a file in place or write a new one and rename it over the old.
+    if (inotify_add_watch(watch_fd, directory, IN_CLOSE_WRITE | IN_MOVED_TO) < 0)
+    {
+        close(watch_fd);
+        watch_fd = -1;
+        return false;
+    }
+    return true;
+}
+
+bool next_changed_file(char *name, size_t capacity)
+{
+    if (watch_fd < 0)
+        return false;
+
+    while (1)
+    {
+        if (watch_buffer_at >= watch_buffer_length)
+        {
+            ssize_t length = read(watch_fd, watch_buffer, sizeof(watch_buffer));
+            if (length <= 0)
+                return false;
+            watch_buffer_length = (int)length;
+            watch_buffer_at = 0;
+        }
+
+        const struct inotify_event *event = (const struct inotify_event *)(watch_buffer + watch_buffer_at);
+        watch_buffer_at += (int)(sizeof(struct inotify_event) + event->len);
+        if (event->len > 0 && strlen(event->name) < capacity)
+        {
+            strcpy(name, event->name);
+            return true;
+        }
+    }
+}
+
+// Script events are queued by the game thread itself, live ones by the
+// stdin thread; each queue has a single producer.
+Event_Queue script_queue;
+Event_Queue stdin_queue;
+
+bool get_next_event(Event *event)
+{
+    return event_queue_pop(&script_queue, event) || event_queue_pop(&stdin_queue, event);
+}
+
+bool update_window_events()
+{
+    while (script_event_next < script_event_count &&
+           script_events[script_event_next].frame <= frame_index)
+    {
+        Event event = script_events[script_event_next].event;
+        event.time = get_time();
+        if (!event_queue_push(&script_queue, event))
+            break;
+        script_event_next++;
+    }
+
+    frame_index++;
+
+    return frame_limit >= 0 && frame_index >= frame_limit;
+}
+
+// event script loading
+
+bool parse_key_code(const char *name, KeyCode *key_code)
+{
+    struct Key_Name
+    {
+        const char *name;
+        KeyCode key_code;
+    };
+
+    static const Key_Name key_names[] = {
+        {"left", KEY_ARROW_LEFT},
+        {"right", KEY_ARROW_RIGHT},
+        {"up", KEY_ARROW_UP},
+        {"down", KEY_ARROW_DOWN},
+        {"shift", KEY_SHIFT},
+        {"escape", KEY_ESCAPE},
+        {"f1", KEY_F1},
+    };
+
+    for (int i = 0; i < (int)(sizeof(key_names) / sizeof(key_names[0])); i++)
+    {
+        if (strcmp(name, key_names[i].name) == 0)
+        {
+            *key_code = key_names[i].key_code;
+            return true;
+        }
+    }
+    return false;
+}
+
+// Parses "<key> <down|up>" or "quit".
+bool parse_event(int fields, const char *what, const char *state, Event *event)
+{
+    if (fields >= 1 && strcmp(what, "quit") == 0)
+    {
+        event->type = EVENT_TYPE_QUIT;
+        return true;
+    }
+    if (fields == 2 && parse_key_code(what, &event->key_code) &&
+        (strcmp(state, "down") == 0 || strcmp(state, "up") == 0))
+    {
+        event->type = EVENT_TYPE_KEYBOARD;
+        event->key_pressed = (strcmp(state, "down") == 0);
+        return true;
+    }
+    return false;
+}
+
+bool load_event_script(const char *filename)
+{
+    FILE *file = fopen(filename, "r");
+    if (!file)
+    {
+        fprintf(stderr, "Could not open event script '%s'\n", filename);
+        return false;
+    }
+
+    int capacity = 0;
+    int line_number = 0;
+    char line[256];
+    while (fgets(line, sizeof(line), file))
+    {
+        line_number++;
+
+        char *comment = strchr(line, '#');
+        if (comment)
+            *comment = 0;
+
+        int frame = 0;
+        char what[32] = {};
+        char state[32] = {};
+        int fields = sscanf(line, "%d %31s %31s", &frame, what, state);
+        if (fields <= 0)
+            continue;
+
+        Script_Event entry = {};
+        entry.frame = frame;
+
+        if (!parse_event(fields - 1, what, state, &entry.event))
+        {
+            fprintf(stderr, "%s:%d: malformed event\n", filename, line_number);
+            fclose(file);
+            return false;
+        }
+
+        if (script_event_count == capacity)
+        {
+            capacity = capacity ? capacity * 2 : 64;
+            script_events = (Script_Event *)realloc(script_events, capacity * sizeof(Script_Event));
+        }
+
+        // Keep the script sorted by frame, preserving file order within a frame.
+        int at = script_event_count++;
+        while (at > 0 && script_events[at - 1].frame > entry.frame)
+        {
+            script_events[at] = script_events[at - 1];
+            at--;
+        }
+        script_events[at] = entry;
+    }
+
+    fclose(file);
+    return true;
+}
+
+// Runs on its own thread for the life of the process, stamping each event
+// as it is read.
+void read_stdin_events()
+{
+    char line[256];
+    while (fgets(line, sizeof(line), stdin))
+    {
+        char *comment = strchr(line, '#');
+        if (comment)
+            *comment = 0;
+
+        char what[32] = {};
+        char state[32] = {};
+        int fields = sscanf(line, "%31s %31s", what, state);
+        if (fields <= 0)
+            continue;
+
+        Event event = {};
+        if (!parse_event(fields, what, state, &event))
+        {
+            fprintf(stderr, "stdin: malformed event\n");
+            continue;
+        }
+        event.time = get_time();
+        event_queue_push(&stdin_queue, event);
+    }
+}
+
+#ifndef INVADERS_NO_MAIN
+
+void *read_whole_file(const char *filename, size_t *size)
+{
+    FILE *file = fopen(filename, "rb");
+    if (!file)
+        return NULL;
+
+    fseek(file, 0, SEEK_END);
+    long length = ftell(file);
+    fseek(file, 0, SEEK_SET);
+
+    void *data = malloc(length > 0 ? length : 1);
+    if (length < 0 || fread(data, 1, length, file) != (size_t)length)
+    {
+        free(data);
+        fclose(file);
+        return NULL;
+    }
+
+    fclose(file);
+    *size = (size_t)length;
+    return data;
+}
+
+// Saves the final world to filename and reports how long taking and
+// restoring a snapshot of it takes.
+bool write_snapshot(const char *filename)
+{
+    size_t capacity = snapshot_size();
+    void *buffer = malloc(capacity);
+
+    const int repeats = 1000;
+    size_t size = 0;
+    double start = get_time();
+    for (int i = 0; i < repeats; i++)
+    {
+        size = save_snapshot(buffer, capacity);
+    }
+    double save_seconds = get_time() - start;
+
+    start = get_time();
+    for (int i = 0; i < repeats; i++)
+    {
+        load_snapshot(buffer, size);
+    }
+    double load_seconds = get_time() - start;
+
+    printf("snapshot bytes: %zu\n", size);
+    printf("snapshot save us: %.2f\n", save_seconds * 1e6 / repeats);
+    printf("snapshot load us: %.2f\n", load_seconds * 1e6 / repeats);
+
+    FILE *file = fopen(filename, "wb");
+    bool written = file && fwrite(buffer, 1, size, file) == size;
+    if (file)
+        fclose(file);
+    free(buffer);
+    return written;
+}
+
+void print_usage(const char *program)
+{
+    fprintf(stderr,
+            "usage: %s [--frames N] [--script FILE] [--uncapped] [--dt SECONDS]\n"
+            "       [--particles N] [--projectiles N] [--render] [--capture FILE]\n"
+            "       [--record FILE] [--replay FILE]\n"
+            "       [--snapshot-in FILE] [--snapshot-out FILE] [--profile] [--trace FILE]\n"
+            "       [--envs N] [--stress FILE] [--threads N] [--stdin]\n"
+            "  --frames N     quit after N frames\n"
+            "  --script FILE  feed input events from FILE\n"
+            "  --stdin        read input events live from standard input\n"
+            "  --uncapped     simulate back to back without drawing or sleeping\n"
+            "  --dt SECONDS   fixed timestep for --uncapped (default 1/120)\n"
+            "  --particles N  capacity of the shared particle pool\n"
+            "  --projectiles N  capacity of the invader projectile pool\n"
+            "  --render       rasterize frames in software\n"
+            "  --capture FILE write the last rendered frame to FILE as PPM (implies --render)\n"
+            "  --record FILE  record frame times and input events to FILE\n"
+            "  --replay FILE  play back a recording instead of live time and input\n"
+            "  --snapshot-in FILE   start from a saved world instead of a fresh one\n"
+            "  --snapshot-out FILE  save the world when the game ends\n"
+            "  --profile      print zone timings for the last frames (needs -DINVADERS_PROFILE=1)\n"
+            "  --trace FILE   write a Chrome trace of every zone to FILE (needs -DINVADERS_PROFILE=1)\n"
+            "  --envs N       step N games in lockstep with random input for --frames steps\n"
+            "  --stress FILE  run each scenario in FILE for --frames ticks and print ns per tick by phase\n"
+            "  --threads N    threads in the job pool (default: every core)\n",
+            program);
+}
+
+void print_startup()
+{
+    Startup_Stats startup = get_startup_stats();
+    printf("startup ms: %.2f\n", startup.total * 1000.0);
+    printf("asset %s ms: %.2f\n", startup.from_pack ? "pack" : "decode", startup.assets * 1000.0);
+    printf("texture upload ms: %.2f\n", startup.upload * 1000.0);
+}
+
+void print_profile()
+{
+    if (profile_frame_count() == 0)
+    {
+        fprintf(stderr, "No zone timings: build with -DINVADERS_PROFILE=1\n");
+        return;
+    }
+    profile_print_report(stdout, profile_frame_max);
+}
+
+// Steps a batch of games with random input and reports throughput.
+int run_envs(int count, int steps)
+{
+    const int episode_ticks = 120 * 60;
+    const int particle_capacity = 1024;
+
+    Env_Batch *batch = env_batch_create(count, 1, episode_ticks, particle_capacity);
+    Env_Action *actions = (Env_Action *)calloc(count, sizeof(Env_Action));
+    Env_Result *results = (Env_Result *)calloc(count, sizeof(Env_Result));
+
+    // Each game holds a random direction for a while and fires now and then.
+    uint32_t rng = 0x12345678;
+    int64_t destroyed = 0;
+    int episodes = 0;
+
+    double start = get_time();
+    for (int step = 0; step < steps; step++)
+    {
+        for (int i = 0; i < count; i++)
+        {
+            rng ^= rng << 13;
+            rng ^= rng >> 17;
+            rng ^= rng << 5;
+            Env_Action *action = &actions[i];
+            if ((rng & 31) == 0)
+            {
+                action->left = (rng >> 5) & 1;
+                action->right = !action->left;
+                action->up = (rng >> 6) & 1;
+                action->down = !action->up;
+            }
+            action->fire = ((rng >> 8) & 15) == 0;
+        }
+
+        env_batch_step(batch, actions, results);
+
+        for (int i = 0; i < count; i++)
+        {
+            destroyed += results[i].reward;
+            episodes += results[i].done;
+        }
+    }
+    double elapsed = get_time() - start;
+
+    printf("envs: %d\n", count);
+    printf("steps: %d\n", steps);
+    printf("seconds: %.3f\n", elapsed);
+    printf("env steps per second: %.0f\n", (double)count * steps / elapsed);
+    printf("invaders destroyed: %lld\n", (long long)destroyed);
+    printf("episodes finished: %d\n", episodes);
+
+    env_batch_destroy(batch);
+    jobs_shutdown();
+    free(actions);
+    free(results);
+    return 0;
+}
+
+// Runs each scenario in filename, one per line as
+// <invaders> <volleys per second> <emitters per explosion>, for ticks ticks,
+// and prints a CSV row per scenario of mean live entities and nanoseconds
+// per tick, in total and by phase.
+int run_stress(const char *filename, int ticks)
+{
+    FILE *file = fopen(filename, "r");
+    if (!file)
+    {
+        fprintf(stderr, "Could not open scenarios '%s'\n", filename);
+        return 1;
+    }
+
+    printf("invaders,fire_rate,emitters_per_explosion,ticks,bullets,projectiles,emitters,particles,"
+           "ns_per_tick,simulate_bullets,simulate_invaders,simulate_projectiles,simulate_emitters\n");
+
+    int line_number = 0;
+    char line[256];
+    while (fgets(line, sizeof(line), file))
+    {
+        line_number++;
+
+        char *comment = strchr(line, '#');
+        if (comment)
+            *comment = 0;
+
+        Stress_Scenario scenario = {};
+        int fields = sscanf(line, "%d %f %d", &scenario.invaders, &scenario.fire_rate, &scenario.emitters_per_explosion);
+        if (fields <= 0)
+            continue;
+        if (fields != 3 || scenario.invaders < 0 || scenario.fire_rate < 0 || scenario.emitters_per_explosion < 0)
+        {
+            fprintf(stderr, "%s:%d: malformed scenario\n", filename, line_number);
+            fclose(file);
+            return 1;
+        }
+
+        Stress_Result result = run_stress_scenario(&scenario, ticks);
+        double ns = 1e9 / (result.ticks > 0 ? result.ticks : 1);
+        printf("%d,%g,%d,%d,%.0f,%.0f,%.0f,%.0f,%.0f,%.0f,%.0f,%.0f,%.0f\n",
+               scenario.invaders, scenario.fire_rate, scenario.emitters_per_explosion, result.ticks,
+               result.bullets, result.projectiles, result.emitters, result.particles, result.seconds * ns,
+               result.phase_seconds[PHASE_BULLETS] * ns, result.phase_seconds[PHASE_INVADERS] * ns,
+               result.phase_seconds[PHASE_PROJECTILES] * ns, result.phase_seconds[PHASE_EMITTERS] * ns);
+        fflush(stdout);
+    }
+
+    fclose(file);
+    jobs_shutdown();
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    bool uncapped = false;
+    const char *capture_filename = NULL;
+    bool replaying = false;
+    const char *snapshot_out_filename = NULL;
+    bool profile = false;
+    int env_count = 0;
+    const char *stress_filename = NULL;
+    void *snapshot_in = NULL;
+    float uncapped_dt = 1.0f / 120.0f;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc)
+        {
+            frame_limit = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--script") == 0 && i + 1 < argc)
+        {
+            if (!load_event_script(argv[++i]))
+                return 1;
+        }
+        else if (strcmp(argv[i], "--stdin") == 0)
+        {
+            std::thread(read_stdin_events).detach();
+        }
+        else if (strcmp(argv[i], "--uncapped") == 0)
+        {
+            uncapped = true;
+        }
+        else if (strcmp(argv[i], "--dt") == 0 && i + 1 < argc)
+        {
+            uncapped_dt = (float)atof(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--particles") == 0 && i + 1 < argc)
+        {
+            particle_pool_max = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--projectiles") == 0 && i + 1 < argc)
+        {
+            projectile_pool_max = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--render") == 0)
+        {
+            software_render = true;
+        }
+        else if (strcmp(argv[i], "--capture") == 0 && i + 1 < argc)
+        {
+            software_render = true;
+            capture_filename = argv[++i];
+        }
+        else if (strcmp(argv[i], "--record") == 0 && i + 1 < argc)
+        {
+            if (!invaders_start_recording(argv[++i]))
+            {
+                fprintf(stderr, "Could not create recording '%s'\n", argv[i]);
+                return 1;
+            }
+        }
+        else if (strcmp(argv[i], "--replay") == 0 && i + 1 < argc)
+        {
+            if (!invaders_start_playback(argv[++i]))
+            {
+                fprintf(stderr, "Could not open recording '%s'\n", argv[i]);
+                return 1;
+            }
+            replaying = true;
+        }
+        else if (strcmp(argv[i], "--snapshot-in") == 0 && i + 1 < argc)
+        {
+            size_t size = 0;
+            snapshot_in = read_whole_file(argv[++i], &size);
+            if (!snapshot_in)
+            {
+                fprintf(stderr, "Could not read snapshot '%s'\n", argv[i]);
+                return 1;
+            }
+            invaders_start_from_snapshot(snapshot_in, size);
+        }
+        else if (strcmp(argv[i], "--snapshot-out") == 0 && i + 1 < argc)
+        {
+            snapshot_out_filename = argv[++i];
+        }
+        else if (strcmp(argv[i], "--profile") == 0)
+        {
+            profile = true;
+        }
+        else if (strcmp(argv[i], "--envs") == 0 && i + 1 < argc)
+        {
+            env_count = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--stress") == 0 && i + 1 < argc)
+        {
+            stress_filename = argv[++i];
+        }
+        else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+        {
+            job_thread_count = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--trace") == 0 && i + 1 < argc)
+        {
+            if (!INVADERS_PROFILE)
+            {
+                fprintf(stderr, "Traces are empty without -DINVADERS_PROFILE=1\n");
+            }
+            if (!profile_trace_start(argv[++i]))
+            {
+                fprintf(stderr, "Could not create trace '%s'\n", argv[i]);
+                return 1;
+            }
+        }
+        else
+        {
+            print_usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (env_count > 0)
+    {
+        if (frame_limit < 0)
+        {
+            fprintf(stderr, "--envs needs --frames\n");
+            return 1;
+        }
+        return run_envs(env_count, frame_limit);
+    }
+
+    if (stress_filename)
+    {
+        if (frame_limit < 0)
+        {
+            fprintf(stderr, "--stress needs --frames\n");
+            return 1;
+        }
+        return run_stress(stress_filename, frame_limit);
+    }
+
+    if (uncapped)
+    {
+        if (frame_limit < 0 && script_event_count == 0 && !replaying)
+        {
+            fprintf(stderr, "--uncapped needs --frames or a script that quits\n");
+            return 1;
+        }
+
+        Uncapped_Result result = invaders_uncapped(frame_limit, uncapped_dt);
+
+        printf("ticks: %d\n", result.ticks);
+        printf("seconds: %.3f\n", result.seconds);
+        printf("ticks per second: %.0f\n", result.ticks / result.seconds);
+        printf("invaders destroyed: %d\n", result.invaders_destroyed);
+        printf("state hash: %08x\n", get_state_hash());
+        print_startup();
+
+        if (profile)
+        {
+            print_profile();
+        }
+
+        if (snapshot_out_filename && !write_snapshot(snapshot_out_filename))
+        {
+            fprintf(stderr, "Could not write snapshot '%s'\n", snapshot_out_filename);
+            return 1;
+        }
+        return 0;
+    }
+
+    double start = get_time();
+    int destroyed = invaders();
+    double elapsed = get_time() - start;
+
+    printf("frames: %d\n", frame_index);
+    printf("seconds: %.3f\n", elapsed);
+    printf("invaders destroyed: %d\n", destroyed);
+    printf("state hash: %08x\n", get_state_hash());
+    print_startup();
+
+    Render_Stats render = get_render_stats();
+    if (render.frames > 0)
+    {
+        printf("draw calls per frame: %.2f\n", (double)render.draw_calls / render.frames);
+        printf("texture binds per frame: %.2f\n", (double)render.texture_binds / render.frames);
+        printf("sprites per frame: %.1f\n", (double)render.quads / render.frames);
+    }
+
+    if (software_render)
+    {
+        Software_Render_Stats stats = software_render_get_stats();
+        if (stats.frames > 0)
+        {
+            printf("render ms per frame: %.3f\n", stats.seconds * 1000.0 / stats.frames);
+            printf("triangles per frame: %.1f\n", (double)stats.triangles / stats.frames);
+            printf("pixels per frame: %.0f\n", (double)stats.pixels / stats.frames);
+        }
+    }
+
+    if (profile)
+    {
+        print_profile();
+    }
+
+    if (snapshot_out_filename && !write_snapshot(snapshot_out_filename))
+    {
+        fprintf(stderr, "Could not write snapshot '%s'\n", snapshot_out_filename);
+        return 1;
+    }
+
+    if (capture_filename && !software_render_write_ppm(capture_filename))
+    {
+        fprintf(stderr, "Could not write capture '%s'\n", capture_filename);
+        return 1;
+    }
+
+    return 0;
+}
+
+#endif // INVADERS_NO_MAIN
@@ -0,0 +1,144 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "asset-pack.h"
+#include "atlas.h"
+
+#define STB_IMAGE_IMPLEMENTATION
+#include "stb_image.h"
+
+// Offline asset packer. Decodes the given PNGs, packs them into one atlas
+// the same way the game does at startup, and writes an asset pack (see
+// asset-pack.h) the game maps instead of decoding anything:
+//
+//     g++ -O2 -o pack-assets pack-assets.cpp atlas.cpp
+//     ./pack-assets invaders.pak ship.png bullet.png contrail.png bug1.png bug2.png bug3.png bug4.png
+//
+// Entries are named after the file name without its directory. A 1x1 white
+// entry named "white" is always added for untextured quads.
+
+const char *base_name(const char *path)
+{
+    const char *slash = strrchr(path, '/');
+    const char *backslash = strrchr(path, '\\');
+    if (backslash > slash)
+        slash = backslash;
+    return slash ? slash + 1 : path;
+}
+
+bool write_padding(FILE *file, long to)
+{
+    while (ftell(file) < to)
+    {
+        if (fputc(0, file) == EOF)
+            return false;
+    }
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 3)
+    {
+        fprintf(stderr, "usage: %s OUTPUT.pak IMAGE.png...\n", argv[0]);
+        return 1;
+    }
+
+    const char *output = argv[1];
+    int image_count = argc - 2;
+    int count = image_count + 1;
+
+    Atlas_Image *images = (Atlas_Image *)calloc(count, sizeof(Atlas_Image));
+    Atlas_Rect *rects = (Atlas_Rect *)calloc(count, sizeof(Atlas_Rect));
+    Asset_Pack_Entry *entries = (Asset_Pack_Entry *)calloc(count, sizeof(Asset_Pack_Entry));
+
+    for (int i = 0; i < image_count; i++)
+    {
+        const char *filename = argv[i + 2];
+        const char *name = base_name(filename);
+        if (strlen(name) >= (size_t)asset_pack_name_max)
+        {
+            fprintf(stderr, "Name '%s' is longer than %d characters\n", name, asset_pack_name_max - 1);
+            return 1;
+        }
+
+        int width = 0;
+        int height = 0;
+        uint8_t *data = stbi_load(filename, &width, &height, NULL, 4);
+        if (!data)
+        {
+            fprintf(stderr, "Could not load '%s': %s\n", filename, stbi_failure_reason());
+            return 1;
+        }
+
+        images[i].width = width;
+        images[i].height = height;
+        images[i].data = data;
+        strcpy(entries[i].name, name);
+    }
+
+    static const uint8_t white[4] = {255, 255, 255, 255};
+    images[image_count].width = 1;
+    images[image_count].height = 1;
+    images[image_count].data = white;
+    strcpy(entries[image_count].name, "white");
+
+    Atlas atlas;
+    if (!build_atlas(images, count, atlas_padding, atlas_max_size, &atlas, rects))
+    {
+        fprintf(stderr, "Images do not fit in a %dx%d atlas\n", atlas_max_size, atlas_max_size);
+        return 1;
+    }
+
+    for (int i = 0; i < count; i++)
+    {
+        entries[i].x = rects[i].x;
+        entries[i].y = rects[i].y;
+        entries[i].width = rects[i].width;
+        entries[i].height = rects[i].height;
+    }
+
+    size_t entries_end = sizeof(Asset_Pack_Header) + count * sizeof(Asset_Pack_Entry);
+
+    Asset_Pack_Header header = {};
+    header.magic = asset_pack_magic;
+    header.version = asset_pack_version;
+    header.entry_count = (uint32_t)count;
+    header.atlas_width = (uint32_t)atlas.width;
+    header.atlas_height = (uint32_t)atlas.height;
+    header.atlas_offset = (uint32_t)((entries_end + asset_pack_alignment - 1) & ~(size_t)(asset_pack_alignment - 1));
+    header.padding = (uint32_t)atlas_padding;
+
+    size_t atlas_bytes = (size_t)atlas.width * atlas.height * 4;
+
+    FILE *file = fopen(output, "wb");
+    if (!file)
+    {
+        fprintf(stderr, "Could not create '%s'\n", output);
+        return 1;
+    }
+
+    bool ok = fwrite(&header, sizeof(header), 1, file) == 1 &&
+              fwrite(entries, sizeof(Asset_Pack_Entry), count, file) == (size_t)count &&
+              write_padding(file, (long)header.atlas_offset) &&
+              fwrite(atlas.data, 1, atlas_bytes, file) == atlas_bytes;
+    ok = fclose(file) == 0 && ok;
+    if (!ok)
+    {
+        fprintf(stderr, "Could not write '%s'\n", output);
+        return 1;
+    }
+
+    printf("%s: %d images in a %dx%d atlas, %zu bytes\n",
+           output, image_count, atlas.width, atlas.height, (size_t)header.atlas_offset + atlas_bytes);
+
+    for (int i = 0; i < image_count; i++)
+    {
+        stbi_image_free((void *)images[i].data);
+    }
+    free_atlas(&atlas);
+    free(entries);
+    free(rects);
+    free(images);
+    return 0;
+}
@@ -0,0 +1,451 @@
+#include <stdlib.h>
+#include <string.h>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include "invaders.h"
+#include "profiler.h"
+
+// Zones form a tree rooted at node 0. Each node accumulates its ticks and
+// calls for the current frame; profile_end_frame moves those totals into
+// the history ring and clears them.
+
+const int profile_zone_max = 128;
+
+struct Profile_Node
+{
+    const char *name;
+    int parent;
+    int first_child;
+    int next_sibling;
+    int depth;
+
+    uint64_t frame_ticks;
+    int frame_calls;
+};
+
+Profile_Node profile_nodes[profile_zone_max] = {{"frame", -1, -1, -1, 0, 0, 0}};
+int profile_node_count = 1;
+int profile_current = 0;
+
+uint64_t profile_history_ticks[profile_frame_max][profile_zone_max];
+uint16_t profile_history_calls[profile_frame_max][profile_zone_max];
+int profile_frames_stored = 0;
+int profile_frame_next = 0;
+
+// Ticks are converted to seconds with a rate measured against get_time()
+// between the first and the latest frame end.
+uint64_t profile_last_frame_end = 0;
+uint64_t profile_calibration_ticks = 0;
+double profile_calibration_time = 0;
+double profile_seconds_per_tick = 0;
+
+uint64_t profile_fallback_ticks()
+{
+    return (uint64_t)(get_time() * 1e9);
+}
+
+thread_local bool profile_thread_ignored = false;
+
+void profile_ignore_thread()
+{
+    profile_thread_ignored = true;
+}
+
+int profile_enter(const char *name)
+{
+    if (profile_thread_ignored)
+        return -1;
+
+    Profile_Node *parent = &profile_nodes[profile_current];
+
+    int zone = parent->first_child;
+    while (zone >= 0 && profile_nodes[zone].name != name &&
+           strcmp(profile_nodes[zone].name, name) != 0)
+    {
+        zone = profile_nodes[zone].next_sibling;
+    }
+
+    if (zone < 0)
+    {
+        if (profile_node_count == profile_zone_max)
+        {
+            // Out of zones: the time is charged to the parent instead.
+            return -1;
+        }
+
+        zone = profile_node_count++;
+        Profile_Node *node = &profile_nodes[zone];
+        node->name = name;
+        node->parent = profile_current;
+        node->first_child = -1;
+        node->next_sibling = parent->first_child;
+        node->depth = parent->depth + 1;
+        node->frame_ticks = 0;
+        node->frame_calls = 0;
+        parent->first_child = zone;
+    }
+
+    profile_current = zone;
+    return zone;
+}
+
+void trace_event(const char *name, uint64_t start, uint64_t end);
+
+void profile_leave(int zone, uint64_t start, uint64_t end)
+{
+    if (zone < 0)
+        return;
+
+    Profile_Node *node = &profile_nodes[zone];
+    node->frame_ticks += end - start;
+    trace_event(node->name, start, end);
+    node->frame_calls++;
+    profile_current = node->parent >= 0 ? node->parent : 0;
+}
+
+void profile_end_frame()
+{
+    uint64_t now_ticks = profile_ticks();
+    double now_time = get_time();
+    if (profile_calibration_ticks == 0)
+    {
+        profile_calibration_ticks = now_ticks;
+        profile_calibration_time = now_time;
+    }
+    else if (now_ticks > profile_calibration_ticks)
+    {
+        profile_seconds_per_tick = (now_time - profile_calibration_time) /
+                                   (double)(now_ticks - profile_calibration_ticks);
+    }
+
+    // The root's time is the time since the previous frame ended, or the
+    // sum of its top-level zones for the first frame.
+    Profile_Node *root = &profile_nodes[0];
+    root->frame_ticks = 0;
+    root->frame_calls = 1;
+    if (profile_last_frame_end)
+    {
+        root->frame_ticks = now_ticks - profile_last_frame_end;
+        trace_event(root->name, profile_last_frame_end, now_ticks);
+    }
+    else
+    {
+        for (int zone = root->first_child; zone >= 0; zone = profile_nodes[zone].next_sibling)
+        {
+            root->frame_ticks += profile_nodes[zone].frame_ticks;
+        }
+    }
+    profile_last_frame_end = now_ticks;
+
+    uint64_t *ticks = profile_history_ticks[profile_frame_next];
+    uint16_t *calls = profile_history_calls[profile_frame_next];
+    for (int i = 0; i < profile_node_count; i++)
+    {
+        Profile_Node *node = &profile_nodes[i];
+        ticks[i] = node->frame_ticks;
+        calls[i] = (uint16_t)(node->frame_calls < 0xffff ? node->frame_calls : 0xffff);
+        node->frame_ticks = 0;
+        node->frame_calls = 0;
+    }
+    // Zones created later start with zeros in frames stored before them.
+    for (int i = profile_node_count; i < profile_zone_max; i++)
+    {
+        ticks[i] = 0;
+        calls[i] = 0;
+    }
+
+    profile_frame_next = (profile_frame_next + 1) % profile_frame_max;
+    if (profile_frames_stored < profile_frame_max)
+    {
+        profile_frames_stored++;
+    }
+}
+
+int profile_frame_count()
+{
+    return profile_frames_stored;
+}
+
+// Depth-first, children in the order they were first entered.
+int profile_collect(int zone, int frames, Profile_Zone_Stats *stats, int count, int max_stats)
+{
+    if (count == max_stats)
+        return count;
+
+    uint64_t min_ticks = UINT64_MAX;
+    uint64_t max_ticks = 0;
+    double total_ticks = 0;
+    double total_calls = 0;
+    for (int f = 0; f < frames; f++)
+    {
+        int slot = (profile_frame_next - 1 - f + profile_frame_max) % profile_frame_max;
+        uint64_t ticks = profile_history_ticks[slot][zone];
+        if (ticks < min_ticks)
+            min_ticks = ticks;
+        if (ticks > max_ticks)
+            max_ticks = ticks;
+        total_ticks += (double)ticks;
+        total_calls += profile_history_calls[slot][zone];
+    }
+
+    double ms_per_tick = profile_seconds_per_tick * 1000.0;
+    Profile_Zone_Stats *out = &stats[count++];
+    out->name = profile_nodes[zone].name;
+    out->depth = profile_nodes[zone].depth;
+    out->min_ms = min_ticks * ms_per_tick;
+    out->mean_ms = total_ticks / frames * ms_per_tick;
+    out->max_ms = max_ticks * ms_per_tick;
+    out->calls_per_frame = total_calls / frames;
+
+    // Children are linked newest first; walk them oldest first.
+    int children[profile_zone_max];
+    int child_count = 0;
+    for (int child = profile_nodes[zone].first_child; child >= 0; child = profile_nodes[child].next_sibling)
+    {
+        children[child_count++] = child;
+    }
+    for (int i = child_count - 1; i >= 0; i--)
+    {
+        count = profile_collect(children[i], frames, stats, count, max_stats);
+    }
+
+    return count;
+}
+
+int profile_get_stats(int frames, Profile_Zone_Stats *stats, int max_stats)
+{
+    if (frames > profile_frames_stored)
+        frames = profile_frames_stored;
+    if (frames <= 0 || max_stats <= 0)
+        return 0;
+
+    return profile_collect(0, frames, stats, 0, max_stats);
+}
+
+void profile_print_report(FILE *file, int frames)
+{
+    Profile_Zone_Stats stats[profile_zone_max];
+    int count = profile_get_stats(frames, stats, profile_zone_max);
+    if (count == 0)
+        return;
+
+    if (frames > profile_frames_stored)
+        frames = profile_frames_stored;
+
+    fprintf(file, "zone timings over the last %d frames (ms per frame)\n", frames);
+    fprintf(file, "%-36s %9s %9s %9s %9s\n", "zone", "min", "mean", "max", "calls");
+    for (int i = 0; i < count; i++)
+    {
+        char label[64];
+        snprintf(label, sizeof(label), "%*s%s", stats[i].depth * 2, "", stats[i].name);
+        fprintf(file, "%-36s %9.4f %9.4f %9.4f %9.1f\n", label,
+                stats[i].min_ms, stats[i].mean_ms, stats[i].max_ms, stats[i].calls_per_frame);
+    }
+}
+
+// Trace capture. The frame thread fills the current chunk; full chunks are
+// queued for the writer, which formats them and hands them back. Only the
+// queue handoff, once per chunk, takes the lock.
+
+const int trace_chunk_events = 8192;
+const int trace_chunk_count = 8;
+
+struct Trace_Event
+{
+    const char *name;
+    uint64_t start;
+    uint64_t end;
+};
+
+struct Trace_Chunk
+{
+    int count;
+    double seconds_per_tick;
+    Trace_Event events[trace_chunk_events];
+};
+
+struct Trace_Writer
+{
+    FILE *file;
+    std::thread thread;
+    std::mutex mutex;
+    std::condition_variable wake;
+
+    Trace_Chunk *full[trace_chunk_count];
+    int full_count;
+    Trace_Chunk *free_chunks[trace_chunk_count];
+    int free_count;
+    bool stopping;
+
+    uint64_t start_ticks;
+    double start_time;
+    bool first_event;
+};
+
+Trace_Writer trace_writer;
+Trace_Chunk *trace_chunk = NULL;
+int64_t trace_dropped = 0;
+
+void write_trace_chunk(Trace_Writer *writer, Trace_Chunk *chunk)
+{
+    double us_per_tick = chunk->seconds_per_tick * 1e6;
+    for (int i = 0; i < chunk->count; i++)
+    {
+        Trace_Event *event = &chunk->events[i];
+        double ts = (double)(int64_t)(event->start - writer->start_ticks) * us_per_tick;
+        double dur = (double)(event->end - event->start) * us_per_tick;
+        fprintf(writer->file, "%s\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":1,\"ts\":%.3f,\"dur\":%.3f}",
+                writer->first_event ? "" : ",", event->name, ts, dur);
+        writer->first_event = false;
+    }
+}
+
+void trace_writer_main(Trace_Writer *writer)
+{
+    std::unique_lock<std::mutex> lock(writer->mutex);
+    while (1)
+    {
+        writer->wake.wait(lock, [writer] { return writer->full_count > 0 || writer->stopping; });
+        if (writer->full_count == 0)
+            break;
+
+        Trace_Chunk *chunk = writer->full[0];
+        writer->full_count--;
+        memmove(writer->full, writer->full + 1, writer->full_count * sizeof(Trace_Chunk *));
+
+        lock.unlock();
+        write_trace_chunk(writer, chunk);
+        lock.lock();
+
+        writer->free_chunks[writer->free_count++] = chunk;
+    }
+}
+
+// Queues the current chunk for writing and takes a free one, or leaves
+// trace_chunk NULL if the writer has not returned any yet.
+void trace_submit_chunk()
+{
+    Trace_Writer *writer = &trace_writer;
+    uint64_t now_ticks = profile_ticks();
+    double now_time = get_time();
+    if (now_ticks > writer->start_ticks)
+    {
+        trace_chunk->seconds_per_tick = (now_time - writer->start_time) / (double)(now_ticks - writer->start_ticks);
+    }
+
+    std::lock_guard<std::mutex> lock(writer->mutex);
+    writer->full[writer->full_count++] = trace_chunk;
+    trace_chunk = NULL;
+    if (writer->free_count > 0)
+    {
+        trace_chunk = writer->free_chunks[--writer->free_count];
+        trace_chunk->count = 0;
+    }
+    writer->wake.notify_one();
+}
+
+void trace_event(const char *name, uint64_t start, uint64_t end)
+{
+    if (!trace_writer.file)
+        return;
+
+    if (!trace_chunk)
+    {
+        std::lock_guard<std::mutex> lock(trace_writer.mutex);
+        if (trace_writer.free_count > 0)
+        {
+            trace_chunk = trace_writer.free_chunks[--trace_writer.free_count];
+            trace_chunk->count = 0;
+        }
+        else
+        {
+            trace_dropped++;
+            return;
+        }
+    }
+
+    Trace_Event *event = &trace_chunk->events[trace_chunk->count++];
+    event->name = name;
+    event->start = start;
+    event->end = end;
+
+    if (trace_chunk->count == trace_chunk_events)
+    {
+        trace_submit_chunk();
+    }
+}
+
+bool profile_trace_start(const char *filename)
+{
+    Trace_Writer *writer = &trace_writer;
+    if (writer->file)
+        return false;
+
+    writer->file = fopen(filename, "w");
+    if (!writer->file)
+        return false;
+
+    fprintf(writer->file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+    writer->first_event = true;
+    writer->start_ticks = profile_ticks();
+    writer->start_time = get_time();
+    writer->stopping = false;
+    writer->full_count = 0;
+    writer->free_count = 0;
+    for (int i = 0; i < trace_chunk_count; i++)
+    {
+        writer->free_chunks[writer->free_count++] = (Trace_Chunk *)malloc(sizeof(Trace_Chunk));
+    }
+    trace_chunk = NULL;
+    trace_dropped = 0;
+
+    writer->thread = std::thread(trace_writer_main, writer);
+    return true;
+}
+
+// Waits for the writer to drain what has been captured so far.
+void profile_trace_stop()
+{
+    Trace_Writer *writer = &trace_writer;
+    if (!writer->file)
+        return;
+
+    if (trace_chunk && trace_chunk->count > 0)
+    {
+        trace_submit_chunk();
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(writer->mutex);
+        writer->stopping = true;
+        writer->wake.notify_one();
+    }
+    writer->thread.join();
+
+    if (trace_chunk)
+    {
+        writer->free_chunks[writer->free_count++] = trace_chunk;
+        trace_chunk = NULL;
+    }
+
+    fprintf(writer->file, "\n]}\n");
+    fclose(writer->file);
+    writer->file = NULL;
+
+    for (int i = 0; i < writer->free_count; i++)
+    {
+        free(writer->free_chunks[i]);
+    }
+    writer->free_count = 0;
+
+    if (trace_dropped > 0)
+    {
+        fprintf(stderr, "trace: dropped %lld events\n", (long long)trace_dropped);
+    }
+}
+
+bool profile_trace_active()
+{
+    return trace_writer.file != NULL;
+}
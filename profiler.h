@@ -0,0 +1,109 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+
+// Scoped timing zones. PROFILE_ZONE("name") times the rest of the enclosing
+// scope. Zones nest: the same name under different parents is a different
+// zone, so the report reads as a call tree. PROFILE_END_FRAME() closes the
+// frame and stores each zone's total for it in a ring buffer of the last
+// profile_frame_max frames.
+//
+// Zones are only recorded on the thread that calls PROFILE_END_FRAME(); other
+// threads that run zoned code must call profile_ignore_thread() first.
+// Both macros compile to nothing unless INVADERS_PROFILE is non-zero, which
+// is the default for MSVC debug builds only.
+
+#ifndef INVADERS_PROFILE
+#ifdef _DEBUG
+#define INVADERS_PROFILE 1
+#else
+#define INVADERS_PROFILE 0
+#endif
+#endif
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#elif defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+const int profile_frame_max = 256;
+
+inline uint64_t profile_ticks()
+{
+#if defined(_MSC_VER) || defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    extern uint64_t profile_fallback_ticks();
+    return profile_fallback_ticks();
+#endif
+}
+
+// Returns the index of the zone for name under the innermost open zone and
+// makes it the innermost.
+int profile_enter(const char *name);
+void profile_leave(int zone, uint64_t start, uint64_t end);
+
+void profile_end_frame();
+
+// Makes zones entered on the calling thread no-ops, for helper threads that
+// run code containing zones.
+void profile_ignore_thread();
+
+struct Profile_Scope
+{
+    int zone;
+    uint64_t start;
+
+    Profile_Scope(const char *name)
+    {
+        zone = profile_enter(name);
+        start = profile_ticks();
+    }
+
+    ~Profile_Scope()
+    {
+        profile_leave(zone, start, profile_ticks());
+    }
+};
+
+#if INVADERS_PROFILE
+#define PROFILE_CONCAT_(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_(a, b)
+#define PROFILE_ZONE(name) Profile_Scope PROFILE_CONCAT(profile_scope_, __LINE__)(name)
+#define PROFILE_END_FRAME() profile_end_frame()
+#else
+#define PROFILE_ZONE(name)
+#define PROFILE_END_FRAME()
+#endif
+
+// Per-frame time spent in a zone, including its children, over the frames
+// it covers. Frames where the zone did not run count as zero.
+struct Profile_Zone_Stats
+{
+    const char *name;
+    int depth;
+    double min_ms;
+    double mean_ms;
+    double max_ms;
+    double calls_per_frame;
+};
+
+// Fills stats with every zone in call-tree order, using the last frames
+// frames (at most profile_frame_max), and returns the number of zones.
+int profile_get_stats(int frames, Profile_Zone_Stats *stats, int max_stats);
+
+// Number of frames the ring buffer currently holds.
+int profile_frame_count();
+
+void profile_print_report(FILE *file, int frames);
+
+// Timeline capture. While a trace is running every zone, and every frame,
+// is appended to a bounded set of event chunks; a writer thread turns full
+// chunks into Chrome trace JSON (chrome://tracing, ui.perfetto.dev) so the
+// frame never waits on the file. If the writer falls behind, events are
+// dropped and counted rather than blocking.
+bool profile_trace_start(const char *filename);
+void profile_trace_stop();
+bool profile_trace_active();
@@ -0,0 +1,169 @@
+#include "rng.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define RNG_SSE2 1
+#endif
+
+const uint32_t philox_m0 = 0xD2511F53;
+const uint32_t philox_m1 = 0xCD9E8D57;
+const uint32_t philox_w0 = 0x9E3779B9;
+const uint32_t philox_w1 = 0xBB67AE85;
+const int philox_rounds = 10;
+
+void philox4x32(Rng_Key key, const uint32_t c[4], uint32_t out[4])
+{
+    uint32_t c0 = c[0], c1 = c[1], c2 = c[2], c3 = c[3];
+    uint32_t k0 = key.k0, k1 = key.k1;
+
+    for (int r = 0; r < philox_rounds; r++)
+    {
+        uint64_t p0 = (uint64_t)philox_m0 * c0;
+        uint64_t p1 = (uint64_t)philox_m1 * c2;
+
+        uint32_t n0 = (uint32_t)(p1 >> 32) ^ c1 ^ k0;
+        uint32_t n2 = (uint32_t)(p0 >> 32) ^ c3 ^ k1;
+        c1 = (uint32_t)p1;
+        c3 = (uint32_t)p0;
+        c0 = n0;
+        c2 = n2;
+
+        k0 += philox_w0;
+        k1 += philox_w1;
+    }
+
+    out[0] = c0;
+    out[1] = c1;
+    out[2] = c2;
+    out[3] = c3;
+}
+
+Rng_Key rng_key(uint32_t seed)
+{
+    Rng_Key key;
+    key.k0 = seed;
+    key.k1 = seed ^ 0x5bd1e995;
+    return key;
+}
+
+Rng_Stream rng_stream(Rng_Key key, uint32_t entity, uint32_t tick, uint32_t purpose)
+{
+    Rng_Stream s;
+    s.key = key;
+    s.counter[0] = 0;
+    s.counter[1] = tick;
+    s.counter[2] = entity;
+    s.counter[3] = purpose;
+    s.used = 4;
+    return s;
+}
+
+uint32_t rng_next(Rng_Stream *s)
+{
+    if (s->used == 4)
+    {
+        philox4x32(s->key, s->counter, s->block);
+        s->counter[0]++;
+        s->used = 0;
+    }
+    return s->block[s->used++];
+}
+
+// The top 24 bits, so every value is exact in a float and max is excluded.
+inline float rng_unit(uint32_t x)
+{
+    return (float)(x >> 8) * (1.0f / 16777216.0f);
+}
+
+float rng_float(Rng_Stream *s, float min, float max)
+{
+    float range = max - min;
+    return min + range * rng_unit(rng_next(s));
+}
+
+#if RNG_SSE2
+// 32x32 -> 64 bit multiply of all four lanes of a by m, split into halves.
+inline void mulhilo_4(__m128i a, __m128i m, __m128i *hi, __m128i *lo)
+{
+    __m128i even = _mm_mul_epu32(a, m);
+    __m128i odd = _mm_mul_epu32(_mm_srli_epi64(a, 32), m);
+    __m128i low_mask = _mm_set_epi32(0, -1, 0, -1);
+
+    *lo = _mm_or_si128(_mm_and_si128(even, low_mask), _mm_slli_epi64(odd, 32));
+    *hi = _mm_or_si128(_mm_srli_epi64(even, 32), _mm_andnot_si128(low_mask, odd));
+}
+
+// Four consecutive blocks starting at counter c; lane j works on block j.
+// Writes the 16 words in stream order.
+void philox4x32_4(Rng_Key key, const uint32_t c[4], uint32_t out[16])
+{
+    __m128i c0 = _mm_add_epi32(_mm_set1_epi32((int)c[0]), _mm_set_epi32(3, 2, 1, 0));
+    __m128i c1 = _mm_set1_epi32((int)c[1]);
+    __m128i c2 = _mm_set1_epi32((int)c[2]);
+    __m128i c3 = _mm_set1_epi32((int)c[3]);
+    __m128i m0 = _mm_set1_epi32((int)philox_m0);
+    __m128i m1 = _mm_set1_epi32((int)philox_m1);
+    uint32_t k0 = key.k0, k1 = key.k1;
+
+    for (int r = 0; r < philox_rounds; r++)
+    {
+        __m128i hi0, lo0, hi1, lo1;
+        mulhilo_4(c0, m0, &hi0, &lo0);
+        mulhilo_4(c2, m1, &hi1, &lo1);
+
+        c0 = _mm_xor_si128(_mm_xor_si128(hi1, c1), _mm_set1_epi32((int)k0));
+        c2 = _mm_xor_si128(_mm_xor_si128(hi0, c3), _mm_set1_epi32((int)k1));
+        c1 = lo1;
+        c3 = lo0;
+
+        k0 += philox_w0;
+        k1 += philox_w1;
+    }
+
+    // Transpose from one register per word to one register per block.
+    __m128i t0 = _mm_unpacklo_epi32(c0, c1);
+    __m128i t1 = _mm_unpacklo_epi32(c2, c3);
+    __m128i t2 = _mm_unpackhi_epi32(c0, c1);
+    __m128i t3 = _mm_unpackhi_epi32(c2, c3);
+    _mm_storeu_si128((__m128i *)(out + 0), _mm_unpacklo_epi64(t0, t1));
+    _mm_storeu_si128((__m128i *)(out + 4), _mm_unpackhi_epi64(t0, t1));
+    _mm_storeu_si128((__m128i *)(out + 8), _mm_unpacklo_epi64(t2, t3));
+    _mm_storeu_si128((__m128i *)(out + 12), _mm_unpackhi_epi64(t2, t3));
+}
+#endif
+
+void rng_fill_floats(Rng_Stream *s, float *out, int count, float min, float max)
+{
+    float range = max - min;
+    int i = 0;
+
+    // Use up the current block first so whole blocks line up with out.
+    while (i < count && s->used < 4)
+    {
+        out[i++] = min + range * rng_unit(s->block[s->used++]);
+    }
+
+#if RNG_SSE2
+    __m128 vmin = _mm_set1_ps(min);
+    __m128 vrange = _mm_set1_ps(range);
+    __m128 vscale = _mm_set1_ps(1.0f / 16777216.0f);
+    for (; i + 16 <= count; i += 16)
+    {
+        uint32_t words[16];
+        philox4x32_4(s->key, s->counter, words);
+        s->counter[0] += 4;
+
+        for (int j = 0; j < 16; j += 4)
+        {
+            __m128i x = _mm_srli_epi32(_mm_loadu_si128((__m128i *)(words + j)), 8);
+            __m128 t = _mm_mul_ps(_mm_cvtepi32_ps(x), vscale);
+            _mm_storeu_ps(out + i + j, _mm_add_ps(vmin, _mm_mul_ps(vrange, t)));
+        }
+    }
+#endif
+
+    for (; i < count; i++)
+    {
+        out[i] = min + range * rng_unit(rng_next(s));
+    }
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <stdint.h>
+
+// Counter-based random numbers (Philox-4x32-10, Salmon et al. 2011). Each
+// number is a pure function of a key and a 128-bit counter, so a stream can
+// be opened anywhere, on any thread, and always yields the same sequence;
+// nothing is shared between streams.
+//
+// The game keys its streams by world seed and numbers them by entity, tick
+// and purpose, so the draws an entity makes in a tick do not depend on what
+// any other entity drew or in which order they ran.
+
+struct Rng_Key
+{
+    uint32_t k0;
+    uint32_t k1;
+};
+
+// Fills out[4] with the block for counter c[4].
+void philox4x32(Rng_Key key, const uint32_t c[4], uint32_t out[4]);
+
+Rng_Key rng_key(uint32_t seed);
+
+struct Rng_Stream
+{
+    Rng_Key key;
+    uint32_t counter[4]; // block, tick, entity, purpose
+    uint32_t block[4];
+    int used;
+};
+
+Rng_Stream rng_stream(Rng_Key key, uint32_t entity, uint32_t tick, uint32_t purpose);
+
+uint32_t rng_next(Rng_Stream *s);
+
+// Uniform in [min, max).
+float rng_float(Rng_Stream *s, float min, float max);
+
+// Same values as count calls to rng_float, but whole blocks are generated
+// and converted a SIMD register at a time.
+void rng_fill_floats(Rng_Stream *s, float *out, int count, float min, float max);
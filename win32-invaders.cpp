@@ -1,6 +1,12 @@
 #include <windows.h> 
 #include <GL/gl.h> 
 #include "invaders.h"
+#include "event-queue.h"
+
+// The window and its message loop live on a dedicated input thread, so
+// input is stamped and queued the moment Windows delivers it instead of
+// when the game gets round to pumping messages. The game thread owns the GL
+// context and drains the queue.
 
 // globals and defines
 HWND  ghWnd;
@@ -10,13 +16,20 @@ HINSTANCE ghInstance;
 int gnCmdShow;
 
 LONG WINAPI MainWndProc(HWND, UINT, WPARAM, LPARAM);
+BOOL bSetupPixelFormat(HDC);
+
+Event_Queue input_queue;
+
+HANDLE window_ready;
+int window_width;
+int window_height;
 
 // platform services to game code
 
 const LPCSTR ClassName = "Invaders!";
 const LPCSTR WindowName = "Invaders!";
 
-bool create_window(int width, int height)
+DWORD WINAPI input_thread(LPVOID)
 {
     WNDCLASSA   wndclass;
 
@@ -32,30 +45,69 @@ bool create_window(int width, int height)
     wndclass.lpszMenuName = WindowName;
     wndclass.lpszClassName = ClassName;
 
-    if (!RegisterClassA(&wndclass))
+    if (RegisterClassA(&wndclass))
+    {
+        /* Create the frame */
+        ghWnd = CreateWindowA(ClassName,
+                              WindowName,
+                              WS_OVERLAPPEDWINDOW | WS_CLIPSIBLINGS | WS_CLIPCHILDREN,
+                              CW_USEDEFAULT,
+                              CW_USEDEFAULT,
+                              window_width,
+                              window_height,
+                              NULL,
+                              NULL,
+                              ghInstance,
+                              NULL);
+    }
+
+    if (ghWnd)
+    {
+        /* show and update main window */
+        ShowWindow(ghWnd, gnCmdShow);
+        UpdateWindow(ghWnd);
+    }
+
+    SetEvent(window_ready);
+    if (!ghWnd)
+        return 1;
+
+    MSG msg;
+    while (GetMessage(&msg, NULL, 0, 0) > 0)
+    {
+        TranslateMessage(&msg);
+        DispatchMessage(&msg);
+    }
+    return 0;
+}
+
+bool create_window(int width, int height)
+{
+    window_width = width;
+    window_height = height;
+    window_ready = CreateEvent(NULL, TRUE, FALSE, NULL);
+
+    HANDLE thread = CreateThread(NULL, 0, input_thread, NULL, 0, NULL);
+    if (!thread)
         return false;
+    CloseHandle(thread);
 
-    /* Create the frame */
-    ghWnd = CreateWindowA(ClassName,
-                          WindowName,
-                          WS_OVERLAPPEDWINDOW | WS_CLIPSIBLINGS | WS_CLIPCHILDREN,
-                          CW_USEDEFAULT,
-                          CW_USEDEFAULT,
-                          width,
-                          height,
-                          NULL,
-                          NULL,
-                          ghInstance,
-                          NULL);
+    WaitForSingleObject(window_ready, INFINITE);
+    CloseHandle(window_ready);
 
     /* make sure window was created */
     if (!ghWnd)
         return false;
 
-    /* show and update main window */
-    ShowWindow(ghWnd, gnCmdShow);
+    // The context is made current on the game thread, which does all the drawing.
+    ghDC = GetDC(ghWnd);
+    if (!bSetupPixelFormat(ghDC))
+        return false;
 
-    UpdateWindow(ghWnd);
+    ghRC = wglCreateContext(ghDC);
+    if (!ghRC)
+        return false;
+    wglMakeCurrent(ghDC, ghRC);
 
     return true;
 }
@@ -71,27 +123,9 @@ void swap_buffers()
     SwapBuffers(ghDC);
 }
 
+// Messages are pumped on the input thread.
 bool update_window_events()
 {
-    MSG        msg;
-
-    /*
-    *  Process all pending messages
-    */
-
-    while (PeekMessage(&msg, NULL, 0, 0, PM_NOREMOVE) == TRUE)
-    {
-        if (GetMessage(&msg, NULL, 0, 0))
-        {
-            TranslateMessage(&msg);
-            DispatchMessage(&msg);
-        }
-        else
-        {
-            return true;
-        }
-    }
-        
     return false;
 }
 
@@ -109,40 +143,162 @@ double get_time()
     return (double)ticks.QuadPart / (double)gPerfFrequency.QuadPart;
 }
 
-int event_buffer_first = 0;
-int event_buffer_last = 0;
-const int event_buffer_max = 1000;
-Event events[event_buffer_max];
+void *map_file(const char *filename, size_t *size)
+{
+    HANDLE file = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE)
+        return NULL;
 
-bool get_next_event(Event *event)
+    void *data = NULL;
+    LARGE_INTEGER file_size;
+    if (GetFileSizeEx(file, &file_size) && file_size.QuadPart > 0)
+    {
+        HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_WRITECOPY, 0, 0, NULL);
+        if (mapping)
+        {
+            // The view keeps the mapping alive once its handle is closed.
+            data = MapViewOfFile(mapping, FILE_MAP_COPY, 0, 0, 0);
+            CloseHandle(mapping);
+        }
+    }
+    CloseHandle(file);
+
+    if (data)
+    {
+        *size = (size_t)file_size.QuadPart;
+    }
+    return data;
+}
+
+void unmap_file(void *data, size_t size)
 {
-    if (event_buffer_first != event_buffer_last)
+    UnmapViewOfFile(data);
+}
+
+// Directory watching. A watcher thread blocks in ReadDirectoryChangesW and
+// hands file names to the game through a small locked ring.
+const int changed_file_max = 64;
+
+bool watching = false;
+CRITICAL_SECTION watch_lock;
+char changed_files[changed_file_max][MAX_PATH];
+int changed_file_first = 0;
+int changed_file_count = 0;
+
+DWORD WINAPI watch_thread(LPVOID directory_handle)
+{
+    HANDLE directory = (HANDLE)directory_handle;
+    DWORD buffer[1024];
+    DWORD length = 0;
+    DWORD filter = FILE_NOTIFY_CHANGE_LAST_WRITE | FILE_NOTIFY_CHANGE_FILE_NAME;
+
+    while (ReadDirectoryChangesW(directory, buffer, sizeof(buffer), FALSE, filter, &length, NULL, NULL))
     {
-        *event = events[event_buffer_first++];
-        if (event_buffer_first == event_buffer_max)
+        BYTE *at = (BYTE *)buffer;
+        while (length > 0)
         {
-            event_buffer_first = 0;
+            FILE_NOTIFY_INFORMATION *info = (FILE_NOTIFY_INFORMATION *)at;
+            if (info->Action == FILE_ACTION_MODIFIED || info->Action == FILE_ACTION_ADDED ||
+                info->Action == FILE_ACTION_RENAMED_NEW_NAME)
+            {
+                char name[MAX_PATH];
+                int name_length = WideCharToMultiByte(CP_UTF8, 0, info->FileName, info->FileNameLength / sizeof(WCHAR),
+                                                      name, MAX_PATH - 1, NULL, NULL);
+                name[name_length] = 0;
+
+                EnterCriticalSection(&watch_lock);
+                if (name_length > 0 && changed_file_count < changed_file_max)
+                {
+                    strcpy(changed_files[(changed_file_first + changed_file_count) % changed_file_max], name);
+                    changed_file_count++;
+                }
+                LeaveCriticalSection(&watch_lock);
+            }
+
+            if (info->NextEntryOffset == 0)
+                break;
+            at += info->NextEntryOffset;
         }
-        return true;
     }
-    return false;
+    return 0;
 }
 
-Event *add_event()
+bool watch_directory(const char *directory)
 {
-    Event *event = &events[event_buffer_last++];
-    event->type = EVENT_TYPE_NONE;
-    event->key_code = KEY_NONE;
-    event->key_pressed = true;
-    if (event_buffer_last == event_buffer_max)
+    HANDLE handle = CreateFileA(directory, FILE_LIST_DIRECTORY, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                                NULL, OPEN_EXISTING, FILE_FLAG_BACKUP_SEMANTICS, NULL);
+    if (handle == INVALID_HANDLE_VALUE)
+        return false;
+
+    InitializeCriticalSection(&watch_lock);
+    HANDLE thread = CreateThread(NULL, 0, watch_thread, handle, 0, NULL);
+    if (!thread)
     {
-        event_buffer_last = 0;
+        CloseHandle(handle);
+        return false;
     }
-    if (event_buffer_last == event_buffer_first)
+    CloseHandle(thread);
+    watching = true;
+    return true;
+}
+
+bool next_changed_file(char *name, size_t capacity)
+{
+    if (!watching)
+        return false;
+
+    bool found = false;
+    EnterCriticalSection(&watch_lock);
+    while (!found && changed_file_count > 0)
     {
-        event = NULL;
+        const char *changed = changed_files[changed_file_first];
+        changed_file_first = (changed_file_first + 1) % changed_file_max;
+        changed_file_count--;
+        if (strlen(changed) < capacity)
+        {
+            strcpy(name, changed);
+            found = true;
+        }
     }
-    return event;
+    LeaveCriticalSection(&watch_lock);
+    return found;
+}
+
+bool get_next_event(Event *event)
+{
+    return event_queue_pop(&input_queue, event);
+}
+
+void push_event(EventType type, KeyCode key_code, bool key_pressed)
+{
+    Event event;
+    event.type = type;
+    event.key_code = key_code;
+    event.key_pressed = key_pressed;
+    event.time = get_time();
+    event_queue_push(&input_queue, event);
+}
+
+KeyCode translate_key(WPARAM key)
+{
+    switch (key)
+    {
+        case VK_LEFT:
+            return KEY_ARROW_LEFT;
+        case VK_RIGHT:
+            return KEY_ARROW_RIGHT;
+        case VK_UP:
+            return KEY_ARROW_UP;
+        case VK_DOWN:
+            return KEY_ARROW_DOWN;
+        case VK_SHIFT:
+            return KEY_SHIFT;
+        case VK_ESCAPE:
+            return KEY_ESCAPE;
+        case VK_F1:
+            return KEY_F1;
+    }
+    return KEY_NONE;
 }
 
 BOOL bSetupPixelFormat(HDC hdc)
@@ -187,105 +343,28 @@ LONG WINAPI MainWndProc(
     LPARAM  lParam)
 {
     LONG    lRet = 1;
-    PAINTSTRUCT    ps;
-    RECT rect;
 
     switch (uMsg)
     {
 
-        case WM_CREATE:
-            ghDC = GetDC(hWnd);
-            if (!bSetupPixelFormat(ghDC))
-                PostQuitMessage(0);
-
-            ghRC = wglCreateContext(ghDC);
-            wglMakeCurrent(ghDC, ghRC);
-            GetClientRect(hWnd, &rect);
-            //initializeGL(rect.right, rect.bottom);
-            break;
-
+        // The game thread owns the GL context and drawing into the window,
+        // so closing only asks it to quit; the window goes with the process.
         case WM_CLOSE:
-        {
-            if (ghRC)
-                wglDeleteContext(ghRC);
-            if (ghDC)
-                ReleaseDC(hWnd, ghDC);
-            ghRC = 0;
-            ghDC = 0;
-
-            DestroyWindow(hWnd);
-            Event *event = add_event();
-            event->type = EVENT_TYPE_QUIT;
-        } break;
+            push_event(EVENT_TYPE_QUIT, KEY_NONE, true);
+            lRet = 0;
+            break;
 
         case WM_DESTROY:
-            if (ghRC)
-                wglDeleteContext(ghRC);
-            if (ghDC)
-                ReleaseDC(hWnd, ghDC);
-
             PostQuitMessage(0);
             break;
 
         case WM_KEYDOWN:
-        {
-            Event *event = add_event();
-            event->type = EVENT_TYPE_KEYBOARD;
-            event->key_pressed = true;
-
-            switch (wParam)
-            {
-                case VK_LEFT:
-                    event->key_code = KEY_ARROW_LEFT;
-                    break;
-                case VK_RIGHT:
-                    event->key_code = KEY_ARROW_RIGHT;
-                    break;
-                case VK_UP:
-                    event->key_code = KEY_ARROW_UP;
-                    break;
-                case VK_DOWN:
-                    event->key_code = KEY_ARROW_DOWN;
-                    break;
-                case VK_SHIFT:
-                    event->key_code = KEY_SHIFT;
-                    break;
-                case VK_ESCAPE:
-                    event->key_code = KEY_ESCAPE;
-                    break;
-            }
-
-        } break;
+            push_event(EVENT_TYPE_KEYBOARD, translate_key(wParam), true);
+            break;
 
         case WM_KEYUP:
-        {
-            Event * event = add_event();
-            event->type = EVENT_TYPE_KEYBOARD;
-            event->key_pressed = false;
-
-            switch (wParam)
-            {
-                case VK_LEFT:
-                    event->key_code = KEY_ARROW_LEFT;
-                    break;
-                case VK_RIGHT:
-                    event->key_code = KEY_ARROW_RIGHT;
-                    break;
-                case VK_UP:
-                    event->key_code = KEY_ARROW_UP;
-                    break;
-                case VK_DOWN:
-                    event->key_code = KEY_ARROW_DOWN;
-                    break;
-                case VK_SHIFT:
-                    event->key_code = KEY_SHIFT;
-                    break;
-                case VK_ESCAPE:
-                    event->key_code = KEY_ESCAPE;
-                    break;
-            }
-
-        } break;
+            push_event(EVENT_TYPE_KEYBOARD, translate_key(wParam), false);
+            break;
 
         default:
             lRet = DefWindowProc(hWnd, uMsg, wParam, lParam);